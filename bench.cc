@@ -0,0 +1,221 @@
+#include "main.hh"
+using namespace rl;
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+
+// Workload: every puzzle running at full speed, updated and drawn
+// as in the game loop but without frame pacing
+static const int BENCH_FRAMES = 600;
+static const int UPDATES_PER_FRAME = 4;  // 240 Hz updates at 60 fps
+
+int bench(const char *path)
+{
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    printf("Cannot open %s\n", path);
+    return 1;
+  }
+
+  SetTargetFPS(0);
+  fprintf(f, "{\n  \"frames_per_level\": %d,\n  \"levels\": [\n", BENCH_FRAMES);
+
+  double total_update = 0, total_draw = 0;
+  long total_steps = 0;
+  scene *prev = NULL;
+  for (int i = 0; i <= 20; i++) {
+    scene *s = scene_game_bench(i);
+    // Both alive at once, as during a transition
+    delete prev;
+    double t_update = 0, t_draw = 0;
+    long steps = 0;
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+      BeginDrawing();
+      double t0 = GetTime();
+      for (int j = 0; j < UPDATES_PER_FRAME; j++) {
+        steps += s->speed();
+        s->update();
+      }
+      double t1 = GetTime();
+      s->draw();
+      EndDrawing();
+      double t2 = GetTime();
+      t_update += t1 - t0;
+      t_draw += t2 - t1;
+    }
+    prev = s;
+
+    fprintf(f, "    {\"level\": %d, \"steps\": %ld, "
+      "\"update_ms\": %.4f, \"draw_ms\": %.4f, \"steps_per_sec\": %.0f}%s\n",
+      i, steps,
+      t_update * 1000 / BENCH_FRAMES, t_draw * 1000 / BENCH_FRAMES,
+      steps / t_update,
+      i == 20 ? "" : ",");
+    total_update += t_update;
+    total_draw += t_draw;
+    total_steps += steps;
+  }
+
+  fprintf(f, "  ],\n");
+  fprintf(f, "  \"update_ms\": %.4f,\n", total_update * 1000 / (21 * BENCH_FRAMES));
+  fprintf(f, "  \"draw_ms\": %.4f,\n", total_draw * 1000 / (21 * BENCH_FRAMES));
+  fprintf(f, "  \"steps_per_sec\": %.0f\n}\n", total_steps / total_update);
+  fclose(f);
+  delete prev;
+
+  // Fails the run if any asset or render target budget was exceeded,
+  // or went untested because nothing was loaded into it
+  jobs::drain();
+  bool measured = memstat::all_measured();
+  if (!measured || !memstat::within_budget()) {
+    memstat::dump();
+    return 1;
+  }
+  return 0;
+}
+
+// Scaling: one count varies per series while the others stay fixed.
+// Each scenario runs for about SCALE_SECS (at least SCALE_MIN_FRAMES)
+static const double SCALE_SECS = 1;
+static const int SCALE_MIN_FRAMES = 2;
+
+static const struct scenario {
+  const char *series;   // Count that varies, or "colli" for density
+  int tracks, fireflies, bellflowers;
+  float colli;
+} SCENARIOS[] = {
+  {"tracks", 10, 100, 4, 0.5},
+  {"tracks", 100, 100, 4, 0.5},
+  {"tracks", 1000, 100, 4, 0.5},
+  {"fireflies", 10, 10, 4, 0.5},
+  {"fireflies", 10, 1000, 4, 0.5},
+  {"fireflies", 10, 100000, 4, 0.5},
+  {"bellflowers", 10, 1000, 4, 0.5},
+  {"bellflowers", 10, 1000, 100, 0.5},
+  {"bellflowers", 10, 1000, 1000, 0.5},
+  {"colli", 100, 1000, 4, 0},
+  {"colli", 100, 1000, 4, 0.5},
+  {"colli", 100, 1000, 4, 1},
+};
+static const int N_SCENARIOS = sizeof SCENARIOS / sizeof SCENARIOS[0];
+
+// Bytes allocated on the main thread's heap and not yet freed, where
+// the allocator reports it. Unlike the resident set, this goes down
+// again when a scenario's board is freed
+static long heap_in_use()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  struct mallinfo2 m = mallinfo2();
+  return (long)(m.uordblks + m.hblkhd);
+#elif defined(__GLIBC__)
+  struct mallinfo m = mallinfo();
+  return (long)(unsigned)m.uordblks + (long)(unsigned)m.hblkhd;
+#elif defined(__APPLE__)
+  return (long)mstats().bytes_used;
+#else
+  return -1;
+#endif
+}
+
+// Least-squares slope of log(y) against log(x)
+static double fit_exponent(const double *x, const double *y, int n)
+{
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (int i = 0; i < n; i++) {
+    double lx = log(x[i]), ly = log(y[i]);
+    sx += lx; sy += ly; sxx += lx * lx; sxy += lx * ly;
+  }
+  return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+int bench_scale(const char *path)
+{
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    printf("Cannot open %s\n", path);
+    return 1;
+  }
+
+  SetTargetFPS(0);
+  // Large boards play more sounds than the mixer has voices for
+  SetTraceLogLevel(LOG_ERROR);
+  fprintf(f, "{\n  \"scenarios\": [\n");
+
+  double step_ms[N_SCENARIOS], frame_draw_ms[N_SCENARIOS];
+  for (int i = 0; i < N_SCENARIOS; i++) {
+    const scenario &c = SCENARIOS[i];
+    // Memory is what the scenario holds while running, over what
+    // was in use before it was built
+    long heap0 = heap_in_use(), gpu0 = memstat::total(true);
+    scene *s = scene_game_generated(c.tracks, c.fireflies, c.bellflowers,
+      c.colli, 20220917 + i);
+    double t_update = 0, t_draw = 0;
+    long steps = 0;
+    int frames = 0;
+    while (frames < BENCH_FRAMES &&
+        (frames < SCALE_MIN_FRAMES || t_update + t_draw < SCALE_SECS)) {
+      BeginDrawing();
+      double t0 = GetTime();
+      for (int j = 0; j < UPDATES_PER_FRAME; j++) {
+        steps += s->speed();
+        s->update();
+      }
+      double t1 = GetTime();
+      s->draw();
+      EndDrawing();
+      double t2 = GetTime();
+      t_update += t1 - t0;
+      t_draw += t2 - t1;
+      frames++;
+    }
+    long heap1 = heap_in_use(), gpu1 = memstat::total(true);
+    double heap_mb = (heap0 < 0 ? -1 : (heap1 - heap0) / 1048576.0);
+    double gpu_mb = (gpu1 - gpu0) / 1048576.0;
+    delete s;
+
+    step_ms[i] = t_update * 1000 / steps;
+    frame_draw_ms[i] = t_draw * 1000 / frames;
+    fprintf(f, "    {\"series\": \"%s\", \"tracks\": %d, \"fireflies\": %d, "
+      "\"bellflowers\": %d, \"colli\": %.2f, \"frames\": %d, "
+      "\"update_ms\": %.4f, \"draw_ms\": %.4f, \"steps_per_sec\": %.0f, "
+      "\"firefly_steps_per_sec\": %.0f, \"heap_mb\": %.2f, \"gpu_mb\": %.2f}%s\n",
+      c.series, c.tracks, c.fireflies, c.bellflowers, c.colli, frames,
+      t_update * 1000 / frames, frame_draw_ms[i], steps / t_update,
+      (double)steps * c.fireflies / t_update, heap_mb, gpu_mb,
+      i == N_SCENARIOS - 1 ? "" : ",");
+    printf("%-12s %5d tracks %6d fireflies %4d bellflowers: "
+      "%8.3f ms/step, %8.2f ms/draw\n",
+      c.series, c.tracks, c.fireflies, c.bellflowers,
+      step_ms[i], frame_draw_ms[i]);
+  }
+  fprintf(f, "  ],\n");
+
+  // Exponent k in time ~ count^k, for simulation steps and drawing
+  fprintf(f, "  \"exponents\": {\n");
+  const char *series[] = {"tracks", "fireflies", "bellflowers"};
+  for (int k = 0; k < 3; k++) {
+    double x[N_SCENARIOS], y_step[N_SCENARIOS], y_draw[N_SCENARIOS];
+    int n = 0;
+    for (int i = 0; i < N_SCENARIOS; i++) {
+      const scenario &c = SCENARIOS[i];
+      if (strcmp(c.series, series[k]) != 0) continue;
+      x[n] = (k == 0 ? c.tracks : k == 1 ? c.fireflies : c.bellflowers);
+      y_step[n] = step_ms[i];
+      y_draw[n] = frame_draw_ms[i];
+      n++;
+    }
+    fprintf(f, "    \"%s\": {\"update\": %.3f, \"draw\": %.3f}%s\n", series[k],
+      fit_exponent(x, y_step, n), fit_exponent(x, y_draw, n),
+      k == 2 ? "" : ",");
+  }
+  fprintf(f, "  }\n}\n");
+  fclose(f);
+  SetTraceLogLevel(LOG_INFO);
+  return 0;
+}
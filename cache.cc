@@ -0,0 +1,145 @@
+#include "main.hh"
+#include "utils.hh"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef PLATFORM_WEB
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+// Open addressing over PROBE consecutive slots; when all of them are
+// taken, the entry stored earliest among them is replaced.
+// A slot's key doubles as its lock: writers claim it by swapping in
+// BUSY, and readers re-check the key after copying the outcome
+static const uint64_t EMPTY = 0, BUSY = 1;
+static const int PROBE = 8;
+static const uint32_t MAGIC = 0x32464543;   // "CEF2"
+
+struct entry {
+  std::atomic<uint64_t> key;
+  std::atomic<uint32_t> stamp;
+  eval_outcome outcome;
+};
+struct header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  std::atomic<uint32_t> clock;
+};
+
+static header *table = nullptr;
+static entry *entries;
+static size_t map_size;
+static bool mapped;
+static std::atomic<long> n_hits(0), n_misses(0), n_stores(0);
+
+void eval_cache::open(const char *path, int capacity)
+{
+  if (table != nullptr) return;
+  map_size = sizeof(header) + sizeof(entry) * (size_t)capacity;
+
+#ifndef PLATFORM_WEB
+  int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+  if (fd >= 0 && ftruncate(fd, map_size) == 0) {
+    void *p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) {
+      table = (header *)p;
+      mapped = true;
+    }
+  }
+  if (fd >= 0) ::close(fd);
+#endif
+  if (table == nullptr) {
+    fprintf(stderr, "Cache %s not mapped; using memory\n", path);
+    table = (header *)calloc(1, map_size);
+    mapped = false;
+  }
+
+  entries = (entry *)(table + 1);
+  if (table->magic != MAGIC || table->version != EVAL_SIM_VERSION ||
+      table->capacity != (uint32_t)capacity) {
+    // New file, or one made with another layout or simulation
+    memset((void *)table, 0, map_size);
+    table->magic = MAGIC;
+    table->version = EVAL_SIM_VERSION;
+    table->capacity = capacity;
+  }
+}
+
+void eval_cache::close()
+{
+  if (table == nullptr) return;
+#ifndef PLATFORM_WEB
+  if (mapped) munmap(table, map_size);
+#endif
+  if (!mapped) free(table);
+  table = nullptr;
+}
+
+static inline uint64_t fix_key(uint64_t key)
+{
+  // Reserved values
+  return (key <= BUSY ? key + 2 : key);
+}
+
+bool eval_cache::lookup(uint64_t key, eval_outcome &o)
+{
+  if (table == nullptr) return false;
+  key = fix_key(key);
+  uint32_t cap = table->capacity;
+  for (int i = 0; i < PROBE; i++) {
+    entry &e = entries[(key + i) % cap];
+    if (e.key.load(std::memory_order_acquire) != key) continue;
+    eval_outcome copy = e.outcome;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (e.key.load(std::memory_order_relaxed) != key) continue;
+    o = copy;
+    n_hits++;
+    return true;
+  }
+  n_misses++;
+  return false;
+}
+
+void eval_cache::store(uint64_t key, const eval_outcome &o)
+{
+  if (table == nullptr) return;
+  key = fix_key(key);
+  uint32_t cap = table->capacity;
+  // Choose an empty slot, the same key, or else the oldest
+  entry *victim = nullptr;
+  uint32_t oldest = UINT32_MAX;
+  for (int i = 0; i < PROBE; i++) {
+    entry &e = entries[(key + i) % cap];
+    uint64_t k = e.key.load(std::memory_order_relaxed);
+    if (k == EMPTY || k == key) { victim = &e; break; }
+    uint32_t stamp = e.stamp.load(std::memory_order_relaxed);
+    if (k != BUSY && stamp < oldest) { oldest = stamp; victim = &e; }
+  }
+  if (victim == nullptr) return;
+
+  uint64_t k = victim->key.load(std::memory_order_relaxed);
+  if (k == BUSY || !victim->key.compare_exchange_strong(k, BUSY,
+      std::memory_order_acquire))
+    return;   // Another writer got there first; this result is dropped
+  victim->outcome = o;
+  victim->stamp.store(table->clock++, std::memory_order_relaxed);
+  victim->key.store(key, std::memory_order_release);
+  n_stores++;
+}
+
+void eval_cache::stats()
+{
+  long used = 0;
+  if (table != nullptr)
+    for (uint32_t i = 0; i < table->capacity; i++)
+      if (entries[i].key.load(std::memory_order_relaxed) > BUSY) used++;
+  fprintf(stderr, "Cache: %ld hits, %ld misses, %ld stores, %ld/%u entries used\n",
+    (long)n_hits, (long)n_misses, (long)n_stores,
+    used, table != nullptr ? table->capacity : 0);
+}
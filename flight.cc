@@ -0,0 +1,94 @@
+#include "main.hh"
+using namespace rl;
+
+#include <cstdio>
+#include <ctime>
+
+// A frame longer than this is a hitch and gets the recent frames
+// written out, at most MAX_DUMPS times a session and DUMP_GAP apart
+static const double HITCH = 1.0 / 20;
+static const double DUMP_GAP = 10;
+static const int MAX_DUMPS = 8;
+
+// About eight seconds at 60 fps
+static const int RING_N = 512;
+
+struct frame_rec {
+  const char *scene;
+  // Seconds; update includes main-thread jobs and snapshot capture
+  float period, update, draw;
+  unsigned short iters;         // Fixed-step updates run
+  unsigned short events;
+  int steps;                    // Simulation steps run
+};
+static frame_rec ring[RING_N];
+static unsigned n_frames = 0;
+static unsigned short pending_events = 0;
+
+static double last_time = -1;
+static double last_dump = -DUMP_GAP;
+static int n_dumps = 0;
+
+void flight::mark(int ev)
+{
+  pending_events |= ev;
+}
+
+void flight::record(double time, double update, double draw,
+  int iters, int steps, const char *scene)
+{
+  double period = (last_time < 0 ? 0 : time - last_time);
+  last_time = time;
+
+  frame_rec &r = ring[n_frames % RING_N];
+  r.scene = scene;
+  r.period = period;
+  r.update = update;
+  r.draw = draw;
+  r.iters = (iters > 0xffff ? 0xffff : iters);
+  r.events = pending_events;
+  r.steps = steps;
+  pending_events = 0;
+  n_frames++;
+
+  if (period > HITCH && n_dumps < MAX_DUMPS && time - last_dump >= DUMP_GAP) {
+    last_dump = time;
+    n_dumps++;
+    dump();
+  }
+}
+
+void flight::dump()
+{
+#ifdef PLATFORM_WEB
+  // No local files; goes to the browser console
+  FILE *f = stdout;
+#else
+  char path[64];
+  snprintf(path, sizeof path, "flight_%u_%u.txt",
+    (unsigned)time(NULL), n_frames);
+  FILE *f = fopen(path, "w");
+  if (f == NULL) return;
+#endif
+
+  unsigned n = (n_frames < RING_N ? n_frames : RING_N);
+  fprintf(f, "Frame %u, last %u frames (ms); "
+    "events: T = transition, A = asset load, U = audio underrun\n",
+    n_frames - 1, n);
+  fprintf(f, "%8s %8s %8s %8s %6s %7s %-3s %s\n",
+    "frame", "period", "update", "draw", "iters", "steps", "ev", "scene");
+  for (unsigned i = n_frames - n; i < n_frames; i++) {
+    const frame_rec &r = ring[i % RING_N];
+    fprintf(f, "%8u %8.2f %8.2f %8.2f %6u %7d %c%c%c %s%s\n",
+      i, r.period * 1000, r.update * 1000, r.draw * 1000, r.iters, r.steps,
+      (r.events & TRANSITION) ? 'T' : '-',
+      (r.events & ASSET_LOAD) ? 'A' : '-',
+      (r.events & AUDIO_UNDERRUN) ? 'U' : '-',
+      r.scene, r.period > HITCH ? "  <" : "");
+  }
+
+#ifndef PLATFORM_WEB
+  fclose(f);
+  printf("Frame hitch, recent frames written to %s\n", path);
+#endif
+}
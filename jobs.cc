@@ -0,0 +1,292 @@
+#include "main.hh"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct job {
+  std::function<void()> fn;
+  bool main;
+  // Unfinished dependencies, plus one until submission completes
+  std::atomic<int> pending;
+  // Set by whoever runs it: a queue may still hold a job that a
+  // waiting thread has already run
+  std::atomic<bool> started;
+  std::atomic<bool> finished;
+  std::mutex mutex;   // Guards `dependents` against `finished` being set
+  std::vector<job_ref> dependents;
+};
+
+struct worker {
+  std::thread thread;
+  std::mutex mutex;
+  std::deque<job_ref> queue;  // Owner takes from the back, thieves the front
+  size_t max_depth = 0;
+  std::atomic<long> busy_ns, n_run;
+  worker() : busy_ns(0), n_run(0) { }
+};
+
+typedef std::chrono::steady_clock clock_type;
+
+static std::vector<worker *> pool;
+static thread_local int self = -1;  // Index of the current worker, if any
+static std::atomic<unsigned> next_worker(0);
+
+// Jobs in all worker queues; idle workers sleep while there are none
+static std::atomic<int> n_queued(0);
+static std::atomic<bool> quit(false);
+static std::mutex idle_mutex;
+static std::condition_variable idle_cv;
+
+// Threads blocked in `jobs::wait()` or `jobs::drain()`;
+// woken whenever a job finishes
+static std::atomic<unsigned> n_finished(0);
+static std::atomic<int> n_waiting(0);
+// Submitted and not yet run, including those waiting on dependencies
+static std::atomic<int> n_unfinished(0);
+static std::mutex done_mutex;
+static std::condition_variable done_cv;
+
+static std::deque<job_ref> main_queue;
+static std::mutex main_mutex;
+static size_t main_max_depth = 0;
+static long main_run = 0;
+
+static clock_type::time_point stats_start;
+
+static bool execute(const job_ref &j);
+
+static void enqueue(const job_ref &j)
+{
+  if (j->main) {
+    std::lock_guard<std::mutex> lock(main_mutex);
+    main_queue.push_back(j);
+    if (main_queue.size() > main_max_depth) main_max_depth = main_queue.size();
+    return;
+  }
+  if (pool.empty()) {
+    execute(j);
+    return;
+  }
+  worker *w = pool[self >= 0 ? self : next_worker++ % pool.size()];
+  {
+    std::lock_guard<std::mutex> lock(w->mutex);
+    w->queue.push_back(j);
+    if (w->queue.size() > w->max_depth) w->max_depth = w->queue.size();
+  }
+  n_queued++;
+  // Taking the lock orders this against a worker about to sleep
+  { std::lock_guard<std::mutex> lock(idle_mutex); }
+  idle_cv.notify_one();
+}
+
+static bool execute(const job_ref &j)
+{
+  if (j->started.exchange(true)) return false;
+  j->fn();
+  j->fn = nullptr;    // Release captures
+  std::vector<job_ref> ready;
+  {
+    std::lock_guard<std::mutex> lock(j->mutex);
+    j->finished = true;
+    ready.swap(j->dependents);
+  }
+  for (const auto &d : ready)
+    if (--d->pending == 0) enqueue(d);
+  n_unfinished--;
+  n_finished++;
+  if (n_waiting > 0) {
+    { std::lock_guard<std::mutex> lock(done_mutex); }
+    done_cv.notify_all();
+  }
+  return true;
+}
+
+// Own queue first, then steal from the others
+static job_ref take(int index)
+{
+  int n = pool.size();
+  for (int k = 0; k < n; k++) {
+    worker *w = pool[((index < 0 ? 0 : index) + k) % n];
+    std::lock_guard<std::mutex> lock(w->mutex);
+    if (w->queue.empty()) continue;
+    job_ref j;
+    if (k == 0 && index >= 0) {
+      j = w->queue.back();
+      w->queue.pop_back();
+    } else {
+      j = w->queue.front();
+      w->queue.pop_front();
+    }
+    n_queued--;
+    return j;
+  }
+  return nullptr;
+}
+
+static void work(int index)
+{
+  self = index;
+  worker *w = pool[index];
+  while (!quit) {
+    job_ref j = take(index);
+    if (j != nullptr) {
+      auto t0 = clock_type::now();
+      if (execute(j)) {
+        w->busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+          clock_type::now() - t0).count();
+        w->n_run++;
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(idle_mutex);
+    idle_cv.wait(lock, []() { return quit || n_queued > 0; });
+  }
+}
+
+void jobs::init()
+{
+  stats_start = clock_type::now();
+#if !defined(PLATFORM_WEB) || defined(WEB_THREADS)
+  // The main thread also runs jobs while it waits
+  unsigned n = std::thread::hardware_concurrency();
+  n = (n > 1 ? n - 1 : 0);
+  for (unsigned i = 0; i < n; i++) pool.push_back(new worker());
+  for (unsigned i = 0; i < n; i++)
+    pool[i]->thread = std::thread(work, (int)i);
+#endif
+}
+
+void jobs::shutdown()
+{
+  quit = true;
+  { std::lock_guard<std::mutex> lock(idle_mutex); }
+  idle_cv.notify_all();
+  for (auto w : pool) {
+    w->thread.join();
+    delete w;
+  }
+  pool.clear();
+}
+
+static job_ref submit(std::function<void()> fn, bool main,
+  const std::vector<job_ref> &deps)
+{
+  job_ref j = std::make_shared<job>();
+  j->fn = std::move(fn);
+  j->main = main;
+  j->pending = 1;
+  j->started = false;
+  j->finished = false;
+  n_unfinished++;
+  for (const auto &d : deps) {
+    if (d == nullptr) continue;
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (d->finished) continue;
+    j->pending++;
+    d->dependents.push_back(j);
+  }
+  if (--j->pending == 0) enqueue(j);
+  return j;
+}
+
+job_ref jobs::run(std::function<void()> fn, const std::vector<job_ref> &deps)
+{
+  return submit(std::move(fn), false, deps);
+}
+
+job_ref jobs::run_main(std::function<void()> fn, const std::vector<job_ref> &deps)
+{
+  return submit(std::move(fn), true, deps);
+}
+
+bool jobs::done(const job_ref &j)
+{
+  return j == nullptr || j->finished;
+}
+
+static bool run_main_one()
+{
+  job_ref j;
+  {
+    std::lock_guard<std::mutex> lock(main_mutex);
+    if (main_queue.empty()) return false;
+    j = main_queue.front();
+    main_queue.pop_front();
+  }
+  if (execute(j)) main_run++;
+  return true;
+}
+
+void jobs::wait(const job_ref &j)
+{
+  while (!done(j)) {
+    unsigned seen = n_finished;
+    if (j->main) {
+      // Main jobs run in order, so the ones before it go first
+      if (self < 0 && run_main_one()) continue;
+    } else {
+      // A job whose dependencies are done can run right here
+      if (j->pending == 0 && execute(j)) break;
+      // Workers also help with other work; the main thread does not,
+      // so that a frame never picks up a long job
+      if (self >= 0) {
+        job_ref k = take(self);
+        if (k != nullptr) { execute(k); continue; }
+      }
+    }
+    std::unique_lock<std::mutex> lock(done_mutex);
+    n_waiting++;
+    done_cv.wait(lock, [seen]() { return n_finished != seen; });
+    n_waiting--;
+  }
+}
+
+void jobs::drain()
+{
+  while (n_unfinished > 0) {
+    unsigned seen = n_finished;
+    if (run_main_one()) continue;
+    std::unique_lock<std::mutex> lock(done_mutex);
+    n_waiting++;
+    done_cv.wait(lock, [seen]() { return n_finished != seen; });
+    n_waiting--;
+  }
+}
+
+void jobs::pump(double budget)
+{
+  auto t0 = clock_type::now();
+  while (run_main_one() &&
+    std::chrono::duration<double>(clock_type::now() - t0).count() < budget) { }
+}
+
+int jobs::workers()
+{
+  return pool.size();
+}
+
+// Utilization is over the time since the last report
+void jobs::stats()
+{
+  auto now = clock_type::now();
+  double secs = std::chrono::duration<double>(now - stats_start).count();
+  stats_start = now;
+  {
+    std::lock_guard<std::mutex> lock(main_mutex);
+    printf("Jobs: %d workers; main: %ld run, %d queued (max %d)\n",
+      (int)pool.size(), main_run, (int)main_queue.size(), (int)main_max_depth);
+    main_run = 0;
+  }
+  for (int i = 0; i < (int)pool.size(); i++) {
+    worker *w = pool[i];
+    std::lock_guard<std::mutex> lock(w->mutex);
+    long busy = w->busy_ns.exchange(0), n = w->n_run.exchange(0);
+    printf("  worker %2d: %5.1f%% busy, %ld run, %d queued (max %d)\n",
+      i, busy / 1e9 / secs * 100, n, (int)w->queue.size(), (int)w->max_depth);
+  }
+}
@@ -0,0 +1,44 @@
+#include "main.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+struct group {
+  const char *scene;
+  int speed;
+  std::vector<float> samples;
+};
+static std::vector<group> groups;
+
+void latency::record(const char *scene, int speed, double secs)
+{
+  for (auto &g : groups)
+    if (g.speed == speed && strcmp(g.scene, scene) == 0) {
+      g.samples.push_back(secs);
+      return;
+    }
+  groups.push_back((group){scene, speed, {(float)secs}});
+}
+
+static inline float percentile(const std::vector<float> &sorted, float p)
+{
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5f);
+  return sorted[i];
+}
+
+void latency::report()
+{
+  printf("Input-to-photon latency (ms)\n");
+  printf("%-8s %5s %7s %7s %7s %7s %7s\n",
+    "scene", "speed", "count", "p50", "p90", "p99", "max");
+  for (auto &g : groups) {
+    std::vector<float> s = g.samples;
+    std::sort(s.begin(), s.end());
+    printf("%-8s %5d %7zu %7.2f %7.2f %7.2f %7.2f\n",
+      g.scene, g.speed, s.size(),
+      percentile(s, 0.5) * 1000, percentile(s, 0.9) * 1000,
+      percentile(s, 0.99) * 1000, s.back() * 1000);
+  }
+}
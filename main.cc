@@ -6,6 +6,8 @@ using namespace rl;
 #endif
 
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 
 #ifdef SHOWCASE
 #include <ctime>
@@ -13,31 +15,94 @@ using namespace rl;
 
 char lang = 0;
 
-static scene *cur_scene, *prev_scene = NULL;
+static scene *cur_scene;
+// Outgoing scenes, oldest first, kept until the current updates
+// have returned; the oldest one was on screen and gets captured
+static std::vector<scene *> prev_scenes;
 static const int TRANSITION_DUR = 360;
-static int transition_timer;
+static int transition_timer = TRANSITION_DUR;   // Not in transition
+// Last frame of the outgoing scene, shown during the first half
+static RenderTexture2D snapshot;
+static bool snapshot_loaded = false, snapshot_valid = false;
 static bool pt_laston = false;
 static float pt_lastx, pt_lasty;
 
+#ifdef LATENCY_PROBE
+// Poll time of the earliest pointer event not yet on screen
+static double pt_poll_time = -1;
+#endif
+
 static float cum_time = 0;
 const float STEP = 1.0f / 240;
 
 Music bgm[2];
-int to_bgm_start = 20;
+bool bgm_ready = false;
+int to_bgm_start = -1;
+bool deferred_loaded = false;
+// Music streams hold about 2/30 s of audio (raylib's default buffers);
+// refilling later than this has likely let them run dry
+static const double BGM_SLACK = 2.0 / 30;
+static double bgm_last_update = -1;
 
 void replace_scene(scene *s)
 {
-  prev_scene = cur_scene;
+  // May be called from inside `cur_scene->update()`
+  prev_scenes.push_back(cur_scene);
   cur_scene = s;
   transition_timer = 0;
+  flight::mark(flight::TRANSITION);
+}
+
+static void capture_snapshot(scene *s)
+{
+  if (!snapshot_loaded) {
+    snapshot = LoadRenderTexture(W, H);
+    memstat::add(memstat::RENDER_TARGET, memstat::rt_size(snapshot));
+    snapshot_loaded = true;
+  }
+  draw_scene(s, snapshot, 1);
+  snapshot_valid = true;
 }
 
 #include <cstdio>
+
+#ifdef PLATFORM_WEB
+static void fetch_res_error(const char *path)
+{
+  printf("Cannot fetch %s\n", path);
+}
+#endif
+
+void fetch_res(const char *path, void (*fn)(const char *path))
+{
+#ifdef PLATFORM_WEB
+  emscripten_async_wget(path, path, fn, fetch_res_error);
+#else
+  fn(path);
+#endif
+}
+
+static void bgm_fetched(const char *path)
+{
+  bgm[0] = LoadMusicStream(path);
+  bgm[1] = LoadMusicStream(path);
+  bgm[0].looping = false;
+  bgm[1].looping = false;
+  memstat::add(memstat::MUSIC, memstat::music_size(bgm[0]));
+  memstat::add(memstat::MUSIC, memstat::music_size(bgm[1]));
+  flight::mark(flight::ASSET_LOAD);
+  bgm_ready = true;
+  to_bgm_start = 20;
+}
+
 static inline void transition_draw()
 {
   float t = (float)transition_timer / TRANSITION_DUR;
   float alpha = (1 - cosf(t * (2 * M_PI))) / 2;
-  if (t < 0.5) prev_scene->draw();
+  if (t < 0.5 && snapshot_valid)
+    DrawTexturePro(snapshot.texture,
+      (Rectangle){0, 0, W, -H}, (Rectangle){0, 0, W, H},
+      (Vector2){0, 0}, 0, WHITE);
   else cur_scene->draw();
   rl::DrawRectangle(0, 0, W, H,
     (Color){0, 0, 0, (unsigned char)(alpha * 255.5)});
@@ -50,13 +115,19 @@ static void update_draw_frame()
   // Mouse
   bool pt_on = IsMouseButtonDown(MOUSE_BUTTON_LEFT);
   // Disable all pointer events during transition
-  if (prev_scene != NULL) pt_on = false;
+  if (transition_timer < TRANSITION_DUR) pt_on = false;
   Vector2 pt_pos = GetMousePosition();
+#ifdef LATENCY_PROBE
+  double poll_time = GetTime();
+#endif
   if (!pt_laston && pt_on) {
     cur_scene->pton(pt_pos.x, pt_pos.y);
     pt_lastx = pt_lasty = nanf("");
   }
   if (pt_on && (pt_pos.x != pt_lastx || pt_pos.y != pt_lasty)) {
+#ifdef LATENCY_PROBE
+    if (pt_poll_time < 0) pt_poll_time = poll_time;
+#endif
     cur_scene->ptmove(pt_pos.x, pt_pos.y);
     pt_lastx = pt_pos.x;
     pt_lasty = pt_pos.y;
@@ -67,40 +138,78 @@ static void update_draw_frame()
   pt_laston = pt_on;
 
   // Update
+  double t_update = GetTime();
+  int iters = 0, steps = 0;
   cum_time += GetFrameTime();
   while (cum_time >= STEP) {
     cum_time -= STEP;
+    iters++;
+    steps += cur_scene->speed();
     cur_scene->update();
-    // Transition
-    if (prev_scene != NULL) {
-      prev_scene->update();
-      transition_timer++;
-      if (transition_timer == TRANSITION_DUR) {
-        delete prev_scene;
-        prev_scene = NULL;
-      }
-    }
+    if (transition_timer < TRANSITION_DUR) transition_timer++;
   }
 
+  // The outgoing scene is frozen from here on
+  if (!prev_scenes.empty()) {
+    capture_snapshot(prev_scenes[0]);
+    for (scene *s : prev_scenes) delete s;
+    prev_scenes.clear();
+  }
+
+  // Continuations of background work, such as texture uploads
+  jobs::pump(0.002);
+
   // Draw
-  if (prev_scene != NULL) {
+  double t_draw = GetTime();
+  if (transition_timer < TRANSITION_DUR) {
     transition_draw();
   } else {
     cur_scene->draw();
   }
 
   // Background music
-  if (to_bgm_start > 0 && (--to_bgm_start) == 0) PlayMusicStream(bgm[0]);
-  UpdateMusicStream(bgm[0]);
-  UpdateMusicStream(bgm[1]);
-  float bgm_time = GetMusicTimePlayed(bgm[0]);
-  if (bgm_time >= 240 && GetMusicTimePlayed(bgm[1]) < 240) {
-    SeekMusicStream(bgm[1], bgm_time - 240);
-    PlayMusicStream(bgm[1]);
-    Music t = bgm[1]; bgm[1] = bgm[0]; bgm[0] = t;
+  if (bgm_ready) {
+    if (to_bgm_start > 0 && (--to_bgm_start) == 0) PlayMusicStream(bgm[0]);
+    if (bgm_last_update >= 0 && t_draw - bgm_last_update > BGM_SLACK &&
+        IsMusicStreamPlaying(bgm[0]))
+      flight::mark(flight::AUDIO_UNDERRUN);
+    bgm_last_update = t_draw;
+    UpdateMusicStream(bgm[0]);
+    UpdateMusicStream(bgm[1]);
+    float bgm_time = GetMusicTimePlayed(bgm[0]);
+    if (bgm_time >= 240 && GetMusicTimePlayed(bgm[1]) < 240) {
+      SeekMusicStream(bgm[1], bgm_time - 240);
+      PlayMusicStream(bgm[1]);
+      Music t = bgm[1]; bgm[1] = bgm[0]; bgm[0] = t;
+    }
   }
 
+  double t_end = GetTime();
   EndDrawing();
+  flight::record(t_end, t_draw - t_update, t_end - t_draw,
+    iters, steps, cur_scene->name());
+
+#ifdef LATENCY_PROBE
+  // The frame just presented reflects every event dispatched before it
+  if (pt_poll_time >= 0) {
+    latency::record(cur_scene->name(), cur_scene->speed(),
+      GetTime() - pt_poll_time);
+    pt_poll_time = -1;
+  }
+  if (IsKeyPressed(KEY_F10)) latency::report();
+#endif
+
+  if (IsKeyPressed(KEY_F8)) jobs::stats();
+  if (IsKeyPressed(KEY_F9)) memstat::dump();
+
+  // Assets not needed by the startup screen are requested
+  // after the first frame is on screen
+  if (!deferred_loaded) {
+    deferred_loaded = true;
+    fetch_res("res/Bellflowers_Wonderland.ogg", bgm_fetched);
+    sound::init();
+    painter::init_deferred();
+  }
 
 #ifdef SHOWCASE
   if (IsKeyPressed(KEY_ENTER)) {
@@ -110,25 +219,84 @@ static void update_draw_frame()
       snprintf(timepath, sizeof timepath, "%u.png", (unsigned)time(NULL));
       path = (const char *)timepath;
     }
-    TakeScreenshot(path);
+    save_image_async(render_scene(cur_scene, 1), path);
   }
 #endif
 }
 
 int main(int argc, char *argv[])
 {
+  jobs::init();
+
+#ifndef PLATFORM_WEB
+  // Headless tools
+  if (argc >= 2 && strcmp(argv[1], "--fuzz") == 0) {
+    int ret = fuzz(argc >= 3 ? atoi(argv[2]) : 60);
+    jobs::shutdown();
+    return ret;
+  }
+  if (argc >= 3 && strcmp(argv[1], "--solve") == 0) {
+    int ret = solve(atoi(argv[2]), argc >= 4 ? atoi(argv[3]) : 60);
+    jobs::shutdown();
+    return ret;
+  }
+#endif
+
+#ifdef SHOWCASE
+  bool batch = (argc >= 3 &&
+    (strcmp(argv[1], "--render") == 0 || strcmp(argv[1], "--replay") == 0 ||
+     strcmp(argv[1], "--glow-check") == 0));
+  SetConfigFlags(FLAG_MSAA_4X_HINT | (batch ? FLAG_WINDOW_HIDDEN : 0));
+#else
   SetConfigFlags(FLAG_MSAA_4X_HINT);
+#endif
   InitWindow(W, H, NULL);
   SetTargetFPS(60);
 
   InitAudioDevice();
-  bgm[0] = LoadMusicStream("res/Bellflowers_Wonderland.ogg");
-  bgm[1] = LoadMusicStream("res/Bellflowers_Wonderland.ogg");
-  bgm[0].looping = false;
-  bgm[1].looping = false;
-  sound::init();
 
   painter::init();
+
+#ifndef PLATFORM_WEB
+  if (argc >= 3 &&
+      (strcmp(argv[1], "--bench") == 0 || strcmp(argv[1], "--bench-scale") == 0)) {
+    // Everything the game loads after its first frame, uploaded
+    // before measuring, as the frame loop would over time
+    fetch_res("res/Bellflowers_Wonderland.ogg", bgm_fetched);
+    sound::init();
+    painter::init_deferred();
+    jobs::drain();
+    SetMasterVolume(0);
+    int ret = (strcmp(argv[1], "--bench") == 0 ?
+      bench(argv[2]) : bench_scale(argv[2]));
+    CloseWindow();
+    jobs::shutdown();
+    return ret;
+  }
+#endif
+#ifdef SHOWCASE
+  if (batch) {
+    sound::init();
+    SetMasterVolume(0);
+    int ret;
+    if (strcmp(argv[1], "--render") == 0)
+      ret = render_batch(argv[2], argc >= 4 ? atof(argv[3]) : 1);
+    else if (strcmp(argv[1], "--glow-check") == 0)
+      ret = glow_check(argv[2],
+        argc >= 4 ? atof(argv[3]) : 2,    // Seconds run before rendering
+        argc >= 5 ? atof(argv[4]) : 1.5); // Mean difference allowed
+    else
+      ret = render_replay(argv[2],
+        argc >= 4 ? atof(argv[3]) : 10,   // Seconds
+        argc >= 5 ? atoi(argv[4]) : 60,   // Frames per second
+        argc >= 6 ? atof(argv[5]) : 1,    // Scale
+        argc >= 7 ? argv[6] : "replay_");
+    CloseWindow();
+    jobs::shutdown();
+    return ret;
+  }
+#endif
+
   cur_scene = scene_startup();
   //cur_scene = scene_game(9);
   //cur_scene = scene_game(20);
@@ -142,7 +310,19 @@ int main(int argc, char *argv[])
     update_draw_frame();
 #endif
 
+#ifdef SHOWCASE
+  finish_saves();
+#endif
+  if (snapshot_loaded) {
+    memstat::sub(memstat::RENDER_TARGET, memstat::rt_size(snapshot));
+    UnloadRenderTexture(snapshot);
+  }
   CloseWindow();
+  jobs::shutdown();
+
+#ifdef LATENCY_PROBE
+  latency::report();
+#endif
 
   return 0;
 }
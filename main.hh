@@ -5,6 +5,9 @@ namespace rl {
 #include "raylib.h"
 }
 #include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
 
 static const int W = 800;
 static const int H = 500;
@@ -18,6 +21,9 @@ public:
   virtual void pton(float, float) {}
   virtual void ptmove(float, float) {}
   virtual void ptoff(float, float) {}
+  // For diagnostics
+  virtual const char *name() { return "?"; }
+  virtual int speed() { return 0; }   // Simulation steps per update
 #ifdef SHOWCASE
   virtual const char *scr() { return nullptr; }
 #endif
@@ -30,6 +36,74 @@ scene *scene_game(int level_id);
 
 void replace_scene(scene *s);
 
+// Offscreen rendering
+
+// Scenes that draw through render targets of their own call this
+// afterwards to get back onto the offscreen target, if one is active
+void resume_scene_target();
+// Draws a scene into a render target at the given scale
+void draw_scene(scene *s, rl::RenderTexture2D &rt, float scale);
+// Scale of the offscreen target being drawn, 1 on screen.
+// Scenes size their own intermediate targets by it
+float scene_target_scale();
+// Intermediate targets cover the whole frame even when the render is
+// tiled, which bounds the scale of a render
+static const float MAX_RENDER_SCALE = 8;
+// Draws a scene into a (W * scale) x (H * scale) image,
+// in tiles if needed
+rl::Image render_scene(scene *s, float scale);
+// Writes an image on a worker thread and unloads it
+void save_image_async(rl::Image img, const char *path);
+// Renders a scene as `render_scene()` does and saves it; the image is
+// read back while the next one is drawn, and saved in the background
+void render_scene_async(scene *s, float scale, const char *path);
+// Waits for all pending renders and saves
+void finish_saves();
+
+// Tools
+
+// A puzzle already running at full speed, for benchmarks
+scene *scene_game_bench(int level_id);
+// A generated board running at full speed, for scaling benchmarks:
+// random circle and segment tracks, of which a fraction `colli`
+// attract or return fireflies
+scene *scene_game_generated(int n_tracks, int n_fireflies, int n_bellflowers,
+  float colli, unsigned seed);
+// Runs the benchmark workload and writes results as JSON
+int bench(const char *path);
+// Runs generated boards of increasing size and fits how the time
+// per step grows with each count
+int bench_scale(const char *path);
+// Runs random boards through the firefly dynamics and checks invariants;
+// writes a minimized failing case in puzzle format if one is found
+int fuzz(int seconds);
+// Samples random arrangements of a puzzle and prints those that solve it
+// as screenshot names, one per line; outcomes persist in eval_cache.bin
+int solve(int puzzle_id, int seconds);
+#ifdef SHOWCASE
+// A puzzle arranged as described by a screenshot name (see `scene::scr()`),
+// optionally already running
+scene *scene_game_config(const char *name, bool run = false);
+// Renders every configuration listed in a file to its screenshot name
+int render_batch(const char *list, float scale);
+// Renders a run of a configuration to numbered frames at a fixed rate
+int render_replay(const char *name, float secs, int fps, float scale,
+  const char *prefix);
+// Draws the glow through the straight-alpha pipeline it replaced
+extern bool glow_reference;
+// Renders every configuration listed in a file after `secs` of running,
+// with the current glow and the reference one; fails if the mean
+// per-channel difference of any exceeds `tolerance` (0-255)
+int glow_check(const char *list, float secs, float tolerance);
+#endif
+
+// Resources
+
+// Calls `fn(path)` once the file at `path` is available.
+// Web builds download files outside the boot package here;
+// natively everything is on disk and `fn` is called right away
+void fetch_res(const char *path, void (*fn)(const char *path));
+
 // Maths
 
 #ifndef M_PI
@@ -65,6 +139,7 @@ struct tint4 {
 class painter {
 public:
   static void init();
+  static void init_deferred();
   static void text(
     const char *s, int size,
     vec2 pos, vec2 anchor,
@@ -99,6 +174,85 @@ public:
   static const char *bellflower_pop_zero(int cur, int total);
 };
 
+// Memory accounting
+
+class memstat {
+public:
+  // Textures, font atlases and render targets live on the GPU;
+  // the rest counts against the (wasm) heap
+  enum category {
+    TEXTURE, FONT, FONT_GLYPHS, SOUND, MUSIC, RENDER_TARGET,
+    N_CATEGORIES
+  };
+  static void add(int cat, long bytes);
+  static void sub(int cat, long bytes) { add(cat, -bytes); }
+  static long tex_size(rl::Texture2D tex);
+  static long font_size(rl::Font font);
+  static long glyphs_size(rl::Font font);
+  static long sound_size(rl::Sound snd);
+  static long music_size(rl::Music mus);
+  static long rt_size(rl::RenderTexture2D rt);
+  // Current sum over the GPU or the heap categories
+  static long total(bool gpu);
+  static bool within_budget();
+  // False, naming them, if some categories never held anything:
+  // their assets were not loaded, so their budgets went untested
+  static bool all_measured();
+  static void dump();
+};
+
+// Input-to-photon latency
+
+class latency {
+public:
+  static void record(const char *scene, int speed, double secs);
+  static void report();
+};
+
+// Flight recorder: the last few seconds of frames, kept always and
+// written out when a frame takes too long. Main thread only
+
+class flight {
+public:
+  enum event { TRANSITION = 1, ASSET_LOAD = 2, AUDIO_UNDERRUN = 4 };
+  // Noted in the next frame recorded
+  static void mark(int ev);
+  static void record(double time, double update, double draw,
+    int iters, int steps, const char *scene);
+  static void dump();
+};
+
+// Job system
+
+// Worker jobs run on a pool of threads with work stealing (Web Workers
+// in the threaded web build; in the single-threaded one they run inline). Main jobs run on the main
+// thread, a budgeted number per frame; GPU uploads go there.
+// A job starts once every job it depends on has finished
+struct job;
+typedef std::shared_ptr<job> job_ref;
+
+class jobs {
+public:
+  static void init();
+  static void shutdown();
+  static job_ref run(std::function<void()> fn,
+    const std::vector<job_ref> &deps = {});
+  static job_ref run_main(std::function<void()> fn,
+    const std::vector<job_ref> &deps = {});
+  static bool done(const job_ref &j);
+  // Runs the job here if it is ready but not yet started, otherwise
+  // blocks; workers also run other jobs while waiting, the main thread
+  // only main jobs queued ahead of a main job it waits for
+  static void wait(const job_ref &j);
+  // Runs main jobs for up to `budget` seconds (at least one if any)
+  static void pump(double budget);
+  // Runs main jobs until every job submitted so far, and every job
+  // those submit, has finished. Main thread only
+  static void drain();
+  static int workers();
+  static void stats();
+};
+
 // Translation
 
 extern char lang;
@@ -0,0 +1,143 @@
+#include "main.hh"
+using namespace rl;
+
+#include <cstdio>
+
+// Budgets are the sizes of the shipped assets with about 10% headroom:
+//   texture: 3.0 MiB of PNGs (res/*.png);
+//   font: 14 MiB of atlases, 2048^2 for size 60 and 1024^2 for
+//     24, 32 and 36 (raylib sizes them from the glyph boxes of the
+//     320 code points), gray + alpha; 0.9 MiB of glyph images;
+//   sound: 897k frames of effects, decoded to stereo float (6.8 MiB);
+//   music: two streams of 2 x 4096 frames, stereo 16-bit (64 KiB);
+//   render target: a game scene holds 18.3 MiB (showcase 36.6 MiB)
+//     and two are alive during a transition, plus the 3 MiB snapshot;
+//     showcase renders add a tile of up to 2048^2 (32 MiB)
+static const struct {
+  const char *name;
+  bool gpu;
+  long budget;
+} categories[memstat::N_CATEGORIES] = {
+  {"texture", true, 4 << 20},
+  {"font", true, 16 << 20},
+  {"font glyphs", false, 1 << 20},
+  {"sound", false, 8 << 20},
+  {"music", false, 128 << 10},
+#ifdef SHOWCASE
+  {"render target", true, 112 << 20},
+#else
+  {"render target", true, 44 << 20},
+#endif
+};
+// Out of the 64 MiB wasm heap (TOTAL_MEMORY), leaving the rest for
+// decoders, the simulation and transient image and wave data
+static const long HEAP_BUDGET = 16 << 20;
+
+static long cur[memstat::N_CATEGORIES];
+static long peak[memstat::N_CATEGORIES];
+static long cur_heap, peak_heap, cur_gpu, peak_gpu;
+
+void memstat::add(int cat, long bytes)
+{
+  bool was_within = (cur[cat] <= categories[cat].budget);
+  cur[cat] += bytes;
+  if (peak[cat] < cur[cat]) peak[cat] = cur[cat];
+  if (categories[cat].gpu) {
+    cur_gpu += bytes;
+    if (peak_gpu < cur_gpu) peak_gpu = cur_gpu;
+  } else {
+    bool heap_was_within = (cur_heap <= HEAP_BUDGET);
+    cur_heap += bytes;
+    if (peak_heap < cur_heap) peak_heap = cur_heap;
+    if (heap_was_within && cur_heap > HEAP_BUDGET)
+      printf("Memory budget exceeded: heap (%ld > %ld KiB)\n",
+        cur_heap >> 10, HEAP_BUDGET >> 10);
+  }
+  if (was_within && cur[cat] > categories[cat].budget)
+    printf("Memory budget exceeded: %s (%ld > %ld KiB)\n",
+      categories[cat].name, cur[cat] >> 10, categories[cat].budget >> 10);
+}
+
+long memstat::total(bool gpu)
+{
+  return gpu ? cur_gpu : cur_heap;
+}
+
+long memstat::tex_size(Texture2D tex)
+{
+  long size = GetPixelDataSize(tex.width, tex.height, tex.format);
+  // A full mipmap chain adds about a third
+  if (tex.mipmaps > 1) size += size / 3;
+  return size;
+}
+
+long memstat::font_size(Font font)
+{
+  // Atlas on the GPU
+  return tex_size(font.texture);
+}
+
+long memstat::glyphs_size(Font font)
+{
+  // CPU copy of every glyph image
+  long size = 0;
+  for (int i = 0; i < font.glyphCount; i++) {
+    const Image &img = font.glyphs[i].image;
+    size += GetPixelDataSize(img.width, img.height, img.format);
+  }
+  size += font.glyphCount * (long)(sizeof(GlyphInfo) + sizeof(Rectangle));
+  return size;
+}
+
+long memstat::sound_size(Sound snd)
+{
+  // Fully decoded in the device format
+  return (long)snd.frameCount * snd.stream.channels * (snd.stream.sampleSize / 8);
+}
+
+long memstat::music_size(Music mus)
+{
+  // Double-buffered stream of 4096 frames per half;
+  // decoder state is not counted
+  return 2 * 4096L * mus.stream.channels * (mus.stream.sampleSize / 8);
+}
+
+long memstat::rt_size(RenderTexture2D rt)
+{
+  // Colour attachment plus a 24-bit depth (+ 8-bit padding) buffer
+  return tex_size(rt.texture) + (long)rt.texture.width * rt.texture.height * 4;
+}
+
+bool memstat::within_budget()
+{
+  for (int i = 0; i < N_CATEGORIES; i++)
+    if (peak[i] > categories[i].budget) return false;
+  return peak_heap <= HEAP_BUDGET;
+}
+
+bool memstat::all_measured()
+{
+  bool all = true;
+  for (int i = 0; i < N_CATEGORIES; i++)
+    if (peak[i] == 0) {
+      printf("Memory not measured: %s (nothing loaded)\n", categories[i].name);
+      all = false;
+    }
+  return all;
+}
+
+void memstat::dump()
+{
+  printf("%-14s %4s %10s %10s %10s\n", "KiB", "", "current", "peak", "budget");
+  for (int i = 0; i < N_CATEGORIES; i++) {
+    printf("%-14s %4s %10ld %10ld %10ld%s\n",
+      categories[i].name, categories[i].gpu ? "gpu" : "heap",
+      cur[i] >> 10, peak[i] >> 10, categories[i].budget >> 10,
+      peak[i] > categories[i].budget ? "  OVER" : "");
+  }
+  printf("%-14s %4s %10ld %10ld %10ld%s\n", "heap total", "",
+    cur_heap >> 10, peak_heap >> 10, HEAP_BUDGET >> 10,
+    peak_heap > HEAP_BUDGET ? "  OVER" : "");
+  printf("%-14s %4s %10ld %10ld\n", "gpu total", "",
+    cur_gpu >> 10, peak_gpu >> 10);
+}
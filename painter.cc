@@ -4,6 +4,7 @@ using namespace rl;
 
 #include <cstdio>
 #include <map>
+#include <string>
 
 static std::map<int, Font> font;
 
@@ -12,6 +13,26 @@ struct tex_record {
   int width, height;
 };
 static std::map<hash_t, tex_record> textures;
+// Textures still being fetched, keyed by path hash
+static std::map<hash_t, hash_t> pending_tex;
+
+// Uploads and unloads a decoded image
+static inline tex_record upload_tex(Image img)
+{
+  tex_record rec = (tex_record){
+    .tex = LoadTextureFromImage(img),
+    .width = img.width,
+    .height = img.height,
+  };
+  UnloadImage(img);
+  memstat::add(memstat::TEXTURE, memstat::tex_size(rec.tex));
+  return rec;
+}
+
+static inline tex_record read_tex(const char *path)
+{
+  return upload_tex(LoadImage(path));
+}
 
 static inline void load_tex(const char *name, const char *path)
 {
@@ -20,13 +41,36 @@ static inline void load_tex(const char *name, const char *path)
     puts("Collision!");
     return;
   }
-  Image img = LoadImage(path);
-  textures[h] = (tex_record){
-    .tex = LoadTextureFromImage(img),
-    .width = img.width,
-    .height = img.height,
-  };
-  UnloadImage(img);
+  textures[h] = read_tex(path);
+}
+
+static void tex_fetched(const char *path)
+{
+  auto p = pending_tex.find(hash(path));
+  if (p == pending_tex.end()) return;
+  hash_t h = p->second;
+  pending_tex.erase(p);
+  // Decode on a worker, upload on the main thread
+  auto img = std::make_shared<Image>();
+  std::string s(path);
+  job_ref decode = jobs::run([img, s]() { *img = LoadImage(s.c_str()); });
+  jobs::run_main([img, h]() {
+    textures[h] = upload_tex(*img);
+    flight::mark(flight::ASSET_LOAD);
+  }, {decode});
+}
+
+// Registers an empty texture that is drawn as nothing until fetched
+static inline void defer_tex(const char *name, const char *path)
+{
+  hash_t h = hash(name);
+  if (textures.count(h) > 0) {
+    puts("Collision!");
+    return;
+  }
+  textures[h] = (tex_record){};
+  pending_tex[hash(path)] = h;
+  fetch_res(path, tex_fetched);
 }
 
 static inline tex_record tex(const char *name)
@@ -48,19 +92,10 @@ void painter::init()
     // 95 = ASCII range (32 ~ 126)
     font[size] = LoadFontEx("res/Imprima_AaKaiSong2.ttf", size,
       (int *)chars_zh, sizeof chars_zh / sizeof chars_zh[0]);
+    memstat::add(memstat::FONT, memstat::font_size(font[size]));
+    memstat::add(memstat::FONT_GLYPHS, memstat::glyphs_size(font[size]));
   }
   load_tex("intro_bg", "res/intro_bg.png");
-  load_tex("avatar_intro", "res/avatar_intro.png");
-  load_tex("avatar_question", "res/avatar_question.png");
-  load_tex("avatar_bellflowers", "res/avatar_bellflowers.png");
-  load_tex("avatar_lightall", "res/avatar_lightall.png");
-  load_tex("avatar_lantern", "res/avatar_lantern.png");
-  load_tex("avatar_cat", "res/avatar_cat.png");
-  load_tex("avatar_bedside", "res/avatar_bedside.png");
-  load_tex("avatar_rain", "res/avatar_rain.png");
-  load_tex("avatar_bush", "res/avatar_bush.png");
-  load_tex("avatar_oracle", "res/avatar_oracle.png");
-  load_tex("avatar_night", "res/avatar_night.png");
 
   load_tex("bellflower_ord", "res/bellflower_ord.png");
   load_tex("bellflower_call", "res/bellflower_call.png");
@@ -72,6 +107,21 @@ void painter::init()
   load_tex("btn_2x", "res/btn_2x.png");
 }
 
+void painter::init_deferred()
+{
+  defer_tex("avatar_intro", "res/avatar_intro.png");
+  defer_tex("avatar_question", "res/avatar_question.png");
+  defer_tex("avatar_bellflowers", "res/avatar_bellflowers.png");
+  defer_tex("avatar_lightall", "res/avatar_lightall.png");
+  defer_tex("avatar_lantern", "res/avatar_lantern.png");
+  defer_tex("avatar_cat", "res/avatar_cat.png");
+  defer_tex("avatar_bedside", "res/avatar_bedside.png");
+  defer_tex("avatar_rain", "res/avatar_rain.png");
+  defer_tex("avatar_bush", "res/avatar_bush.png");
+  defer_tex("avatar_oracle", "res/avatar_oracle.png");
+  defer_tex("avatar_night", "res/avatar_night.png");
+}
+
 static inline unsigned char to_u8(float x) { return (unsigned char)(255.0f * x); }
 static inline Color to_rl(tint4 tint) {
   return (Color){
@@ -138,6 +188,7 @@ void painter::image(
   tint4 tint)
 {
   auto rec = tex(name);
+  if (rec.tex.id == 0) return;  // Not fetched yet
   DrawTexturePro(rec.tex,
     (Rectangle){src_pos.x, src_pos.y, src_dims.x, src_dims.y},
     (Rectangle){pos.x, pos.y, dims.x, dims.y},
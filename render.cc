@@ -0,0 +1,309 @@
+#include "main.hh"
+using namespace rl;
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+
+// Current offscreen target of scene drawing, if any
+static RenderTexture2D *target = nullptr;
+static Camera2D target_cam;
+
+void resume_scene_target()
+{
+  if (target == nullptr) return;
+  BeginTextureMode(*target);
+  BeginMode2D(target_cam);
+}
+
+static void draw_scene_cam(scene *s, RenderTexture2D &rt, Camera2D cam)
+{
+  target = &rt;
+  target_cam = cam;
+  resume_scene_target();
+  ClearBackground(BLACK);
+  s->draw();
+  EndMode2D();
+  EndTextureMode();
+  target = nullptr;
+}
+
+float scene_target_scale()
+{
+  return (target == nullptr ? 1 : target_cam.zoom);
+}
+
+void draw_scene(scene *s, RenderTexture2D &rt, float scale)
+{
+  draw_scene_cam(s, rt,
+    (Camera2D){(Vector2){0, 0}, (Vector2){0, 0}, 0, scale});
+}
+
+// Larger renders are split into tiles of at most this size
+static const int TILE = 2048;
+
+static Image read_target(RenderTexture2D &rt)
+{
+  Image img = LoadImageFromTexture(rt.texture);
+  ImageFlipVertical(&img);
+  return img;
+}
+
+// Tiles alternate between two targets, and each is read back only
+// after the next one has been drawn
+Image render_scene(scene *s, float scale)
+{
+  int w = (int)(W * scale + 0.5f), h = (int)(H * scale + 0.5f);
+  int tile_w = (w < TILE ? w : TILE), tile_h = (h < TILE ? h : TILE);
+  Image img = GenImageColor(w, h, BLACK);
+  int n_rt = (tile_w < w || tile_h < h ? 2 : 1);
+  RenderTexture2D rt[2];
+  for (int i = 0; i < n_rt; i++) {
+    rt[i] = LoadRenderTexture(tile_w, tile_h);
+    memstat::add(memstat::RENDER_TARGET, memstat::rt_size(rt[i]));
+  }
+
+  auto copy_tile = [&](RenderTexture2D &rt, int x, int y) {
+    Image tile = read_target(rt);
+    float cw = (x + tile_w > w ? w - x : tile_w);
+    float ch = (y + tile_h > h ? h - y : tile_h);
+    ImageDraw(&img, tile,
+      (Rectangle){0, 0, cw, ch},
+      (Rectangle){(float)x, (float)y, cw, ch}, WHITE);
+    UnloadImage(tile);
+  };
+  int n = 0, last_x = 0, last_y = 0;
+  for (int y = 0; y < h; y += tile_h)
+    for (int x = 0; x < w; x += tile_w) {
+      draw_scene_cam(s, rt[n % n_rt], (Camera2D){
+        (Vector2){(float)-x, (float)-y}, (Vector2){0, 0}, 0, scale});
+      if (n > 0) copy_tile(rt[(n - 1) % n_rt], last_x, last_y);
+      last_x = x;
+      last_y = y;
+      n++;
+    }
+  copy_tile(rt[(n - 1) % n_rt], last_x, last_y);
+
+  for (int i = 0; i < n_rt; i++) {
+    memstat::sub(memstat::RENDER_TARGET, memstat::rt_size(rt[i]));
+    UnloadRenderTexture(rt[i]);
+  }
+  return img;
+}
+
+// Frames of render_scene_async(): two targets of the frame size, one
+// drawn while the other holds the previous frame, waiting for readback
+static RenderTexture2D queue_rt[2];
+static int queue_w = 0, queue_h = 0;
+static int queue_next = 0;          // Target drawn next
+static bool queue_pending = false;  // The other target holds a frame
+static std::string queue_path;
+
+static void flush_queue()
+{
+  if (!queue_pending) return;
+  save_image_async(read_target(queue_rt[1 - queue_next]), queue_path.c_str());
+  queue_pending = false;
+}
+
+static void release_queue()
+{
+  if (queue_w == 0) return;
+  for (int i = 0; i < 2; i++) {
+    memstat::sub(memstat::RENDER_TARGET, memstat::rt_size(queue_rt[i]));
+    UnloadRenderTexture(queue_rt[i]);
+  }
+  queue_w = queue_h = 0;
+}
+
+void render_scene_async(scene *s, float scale, const char *path)
+{
+  int w = (int)(W * scale + 0.5f), h = (int)(H * scale + 0.5f);
+  if (w > TILE || h > TILE) {
+    flush_queue();
+    save_image_async(render_scene(s, scale), path);
+    return;
+  }
+  if (w != queue_w || h != queue_h) {
+    flush_queue();
+    release_queue();
+    for (int i = 0; i < 2; i++) {
+      queue_rt[i] = LoadRenderTexture(w, h);
+      memstat::add(memstat::RENDER_TARGET, memstat::rt_size(queue_rt[i]));
+    }
+    queue_w = w;
+    queue_h = h;
+  }
+  draw_scene(s, queue_rt[queue_next], scale);
+  // The previous frame, while this one is being drawn
+  flush_queue();
+  queue_path = path;
+  queue_pending = true;
+  queue_next = 1 - queue_next;
+}
+
+// PNG encoding happens in jobs; at most MAX_IN_FLIGHT images
+// are pending, after which save_image_async() blocks
+static const int MAX_IN_FLIGHT = 8;
+static std::deque<job_ref> saves;
+
+void save_image_async(Image img, const char *path)
+{
+  while (!saves.empty() &&
+      (saves.size() >= MAX_IN_FLIGHT || jobs::done(saves.front()))) {
+    jobs::wait(saves.front());
+    saves.pop_front();
+  }
+  std::string p(path);
+  saves.push_back(jobs::run([img, p]() {
+    ExportImage(img, p.c_str());
+    UnloadImage(img);
+  }));
+}
+
+void finish_saves()
+{
+  flush_queue();
+  release_queue();
+  for (const auto &j : saves) jobs::wait(j);
+  saves.clear();
+}
+
+#ifdef SHOWCASE
+static bool valid_scale(float scale)
+{
+  if (scale > 0 && scale <= MAX_RENDER_SCALE) return true;
+  printf("Scale must be positive and at most %g\n", MAX_RENDER_SCALE);
+  return false;
+}
+
+// Each line of the list: <configuration name> [output path]
+// The output defaults to the configuration name itself
+int render_batch(const char *list, float scale)
+{
+  if (!valid_scale(scale)) return 1;
+  FILE *f = fopen(list, "r");
+  if (f == NULL) {
+    printf("Cannot open %s\n", list);
+    return 1;
+  }
+  int count = 0, errors = 0;
+  char line[512], name[256], path[256];
+  while (fgets(line, sizeof line, f) != NULL) {
+    int n = sscanf(line, "%255s %255s", name, path);
+    if (n < 1 || name[0] == '#') continue;
+    scene *s = scene_game_config(name);
+    if (s == nullptr) {
+      printf("Invalid configuration %s\n", name);
+      errors++;
+      continue;
+    }
+    render_scene_async(s, scale, n >= 2 ? path : name);
+    delete s;
+    count++;
+  }
+  fclose(f);
+  finish_saves();
+  printf("Rendered %d images\n", count);
+  return errors > 0 ? 1 : 0;
+}
+
+// Virtual time: each frame advances the scene by as many 240 Hz updates
+// as the frame rate implies, with no real-time constraint
+int render_replay(const char *name, float secs, int fps, float scale,
+  const char *prefix)
+{
+  if (!valid_scale(scale)) return 1;
+  scene *s = scene_game_config(name, true);
+  if (s == nullptr) {
+    printf("Invalid configuration %s\n", name);
+    return 1;
+  }
+  const int UPDATE_RATE = 240;
+  int frames = (int)(secs * fps + 0.5f);
+  long updates = 0;
+  char path[256];
+  for (int i = 0; i < frames; i++) {
+    // Updates due by the end of this frame
+    long target = (long)(i + 1) * UPDATE_RATE / fps;
+    for (; updates < target; updates++) s->update();
+    snprintf(path, sizeof path, "%s%05d.png", prefix, i);
+    render_scene_async(s, scale, path);
+  }
+  delete s;
+  finish_saves();
+  printf("Rendered %d frames; to encode:\n"
+    "  ffmpeg -framerate %d -i %s%%05d.png -pix_fmt yuv420p out.mp4\n",
+    frames, fps, prefix);
+  return 0;
+}
+// Both renders of a configuration see the same scene state, so any
+// difference comes from the glow pipeline alone
+int glow_check(const char *list, float secs, float tolerance)
+{
+  FILE *f = fopen(list, "r");
+  if (f == NULL) {
+    printf("Cannot open %s\n", list);
+    return 1;
+  }
+  int count = 0, errors = 0;
+  char line[512], name[256], path[300];
+  while (fgets(line, sizeof line, f) != NULL) {
+    if (sscanf(line, "%255s", name) < 1 || name[0] == '#') continue;
+    scene *s = scene_game_config(name, true);
+    if (s == nullptr) {
+      printf("Invalid configuration %s\n", name);
+      errors++;
+      continue;
+    }
+    for (int i = 0, n = (int)(secs * 240); i < n; i++) s->update();
+
+    glow_reference = false;
+    Image cur = render_scene(s, 1);
+    glow_reference = true;
+    Image ref = render_scene(s, 1);
+    glow_reference = false;
+    delete s;
+
+    Color *a = LoadImageColors(cur);
+    Color *b = LoadImageColors(ref);
+    int n_px = cur.width * cur.height;
+    double sum = 0;
+    int max = 0;
+    for (int i = 0; i < n_px; i++) {
+      int d[4] = {
+        abs(a[i].r - b[i].r), abs(a[i].g - b[i].g),
+        abs(a[i].b - b[i].b), abs(a[i].a - b[i].a),
+      };
+      for (int c = 0; c < 4; c++) {
+        sum += d[c];
+        if (max < d[c]) max = d[c];
+      }
+    }
+    UnloadImageColors(a);
+    UnloadImageColors(b);
+    double mean = (n_px > 0 ? sum / (n_px * 4) : 0);
+
+    bool ok = (mean <= tolerance);
+    printf("%-4s %s: mean difference %.3f, max %d\n",
+      ok ? "ok" : "FAIL", name, mean, max);
+    if (ok) {
+      UnloadImage(cur);
+      UnloadImage(ref);
+    } else {
+      snprintf(path, sizeof path, "glow_%s.png", name);
+      save_image_async(cur, path);
+      snprintf(path, sizeof path, "glow_%s_ref.png", name);
+      save_image_async(ref, path);
+      errors++;
+    }
+    count++;
+  }
+  fclose(f);
+  finish_saves();
+  printf("Checked %d configurations, %d failed\n", count, errors);
+  return errors > 0 ? 1 : 0;
+}
+#endif
@@ -1,29 +1,22 @@
 #version 330
 
 uniform sampler2D texture0;
-in vec2 fragTexCoord;
 out vec4 outValue;
 
 in vec2 samplePosition[11];
 
-vec4 premul(vec2 pos)
-{
-  vec4 value = texture(texture0, pos);
-  value.rgb *= value.a;
-  return value;
-}
+#define tap(i) texture(texture0, samplePosition[i])
 
 void main()
 {
-  vec4 blurA = vec4(0);
-  blurA += 0.15497842 * (premul(samplePosition[5]));
-  blurA += 0.14464653 * (premul(samplePosition[4]) + premul(samplePosition[6]));
-  blurA += 0.11752530 * (premul(samplePosition[3]) + premul(samplePosition[7]));
-  blurA += 0.08295904 * (premul(samplePosition[2]) + premul(samplePosition[8]));
-  blurA += 0.05069719 * (premul(samplePosition[1]) + premul(samplePosition[9]));
-  blurA += 0.02668273 * (premul(samplePosition[0]) + premul(samplePosition[10]));
+  // Premultiplied alpha throughout, so taps are summed as they are
+  vec4 blur = vec4(0);
+  blur += 0.15497842 * (tap(5));
+  blur += 0.14464653 * (tap(4) + tap(6));
+  blur += 0.11752530 * (tap(3) + tap(7));
+  blur += 0.08295904 * (tap(2) + tap(8));
+  blur += 0.05069719 * (tap(1) + tap(9));
+  blur += 0.02668273 * (tap(0) + tap(10));
 
-  outValue = blurA;
-  if (outValue.a != 0.0) outValue.rgb /= outValue.a;
-  if (samplePosition[0].x == fragTexCoord.x) outValue.a = pow(outValue.a, 0.8);
+  outValue = blur;
 }
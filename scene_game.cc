@@ -1,10 +1,53 @@
 #include "main.hh"
 #include "utils.hh"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
 #include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#ifdef SHOWCASE
+bool glow_reference = false;
+
+// Straight-alpha blur of the glow pipeline before it went premultiplied,
+// kept as the reference for `glow_check()`
+static const char *BLOOM_REF_FRAG = R"(#version 330
+uniform sampler2D texture0;
+in vec2 fragTexCoord;
+out vec4 outValue;
+in vec2 samplePosition[11];
+
+vec4 premul(vec2 pos)
+{
+  vec4 value = texture(texture0, pos);
+  value.rgb *= value.a;
+  return value;
+}
+
+void main()
+{
+  vec4 blurA = vec4(0);
+  blurA += 0.15497842 * (premul(samplePosition[5]));
+  blurA += 0.14464653 * (premul(samplePosition[4]) + premul(samplePosition[6]));
+  blurA += 0.11752530 * (premul(samplePosition[3]) + premul(samplePosition[7]));
+  blurA += 0.08295904 * (premul(samplePosition[2]) + premul(samplePosition[8]));
+  blurA += 0.05069719 * (premul(samplePosition[1]) + premul(samplePosition[9]));
+  blurA += 0.02668273 * (premul(samplePosition[0]) + premul(samplePosition[10]));
+
+  outValue = blurA;
+  if (outValue.a != 0.0) outValue.rgb /= outValue.a;
+  if (samplePosition[0].x == fragTexCoord.x) outValue.a = pow(outValue.a, 0.8);
+}
+)";
+#endif
+
 static inline bool seg_intxn(
   const vec2 a, const vec2 b,
   const vec2 c, const vec2 d
@@ -13,6 +56,21 @@ static inline bool seg_intxn(
          (a - c).det(d - c) * (b - c).det(d - c) <= 0;
 }
 
+static void appendf(std::string &s, const char *fmt, ...)
+{
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf, sizeof buf, fmt, args);
+  va_end(args);
+  if (n < (int)sizeof buf) { s += buf; return; }
+  std::string t(n, '\0');
+  va_start(args, fmt);
+  vsnprintf(&t[0], n + 1, fmt, args);
+  va_end(args);
+  s += t;
+}
+
 class scene_game : public scene {
 public:
   // ==== Display-related constants ====
@@ -57,9 +115,25 @@ public:
     // Returns <phase, distance>
     virtual std::pair<float, float> local_nearest(vec2 p) const = 0;
     std::pair<float, float> nearest(vec2 p) const { return local_nearest(p - o); }
+    // Phases of fireflies lie in [0, len); `len` itself, reached by
+    // rounding or at the end of an open track, becomes the last one below
+    inline float phase(float t) const { return t < len ? t : nextafterf(len, 0); }
 
     virtual void draw(int T) const = 0;
 
+    virtual track *clone() const = 0;
+    // Appends the source form as in puzzles.hh
+    virtual void write(std::string &s) const = 0;
+    inline void write_flags(std::string &s) const {
+      if (flags == 0) { s += "0"; return; }
+      const char *sep = "";
+      for (auto f : {ATTRACT, RETURN, FIXED}) if (flags & f) {
+        appendf(s, "%strack::%s", sep,
+          f == ATTRACT ? "ATTRACT" : f == RETURN ? "RETURN" : "FIXED");
+        sep = " | ";
+      }
+    }
+
     inline rl::Color tint() const {
       rl::Color t = (rl::Color){128, 128, 128, 255};
       if (flags & ATTRACT) t = (rl::Color){136, 136, 64, 255};
@@ -96,11 +170,17 @@ public:
     }
   };
 
+  // Premultiplied, for the glow targets; brightness falls off as alpha squared
   static inline rl::Color premul_alpha(rl::Color tint, float alpha) {
+    float k = alpha * alpha;
+#ifdef SHOWCASE
+    // The reference pipeline squares it in the blur instead
+    if (glow_reference) k = alpha;
+#endif
     return (rl::Color){
-      (unsigned char)(tint.r * alpha),
-      (unsigned char)(tint.g * alpha),
-      (unsigned char)(tint.b * alpha),
+      (unsigned char)(tint.r * k),
+      (unsigned char)(tint.g * k),
+      (unsigned char)(tint.b * k),
       (unsigned char)(tint.a * alpha),
     };
   }
@@ -120,6 +200,12 @@ public:
       if (a < 0) a += 2 * M_PI;
       return {a * r, (p - vec2(r, 0).rot(a)).norm()};
     }
+    track *clone() const { return new track_cir(*this); }
+    void write(std::string &s) const {
+      appendf(s, "T_cir(vec2(%.9g, %.9g), %.9g, ", o.x, o.y, r);
+      write_flags(s);
+      appendf(s, ", %.9g, %d)", fix_angle, fix_count);
+    }
     void draw(int T) const {
       using namespace rl;
       float w = (flags & FIXED) ? 2 : 2;
@@ -163,6 +249,13 @@ public:
       t = (t < -len / 2 ? -len / 2 : (t > len / 2 ? len / 2 : t));
       return {t + len / 2, (p - (ext * t)).norm()};
     }
+    track *clone() const { return new track_seg(*this); }
+    void write(std::string &s) const {
+      appendf(s, "T_seg(vec2(%.9g, %.9g), vec2(%.9g, %.9g), ",
+        o.x, o.y, ext.x * len / 2, ext.y * len / 2);
+      write_flags(s);
+      s += ")";
+    }
     void draw(int T) const {
       using namespace rl;
       DrawLineEx(
@@ -193,6 +286,242 @@ public:
     }
   };
 
+  // Arbitrary curves, resampled uniformly by arc length when created
+  // so that phase lookup is an interpolation between two samples
+  struct track_curve : public track {
+    static const int N = 256;     // Samples along the curve
+    static const int GRID = 32;   // Lookup grid cells along each axis
+    // Distance within which the lookup grid is exact
+    static constexpr float MARGIN = 0.25;
+
+    bool closed;
+    vec2 pts[N + 1];  // Equally spaced; pts[N] == pts[0] if closed
+    vec2 seg_d[N];    // pts[i + 1] - pts[i]
+    float seg_inv2[N];  // 1 / |seg_d[i]|^2, or 0 if degenerate
+    vec2 grid_lo, grid_cell;
+    // Segments (pts[i], pts[i + 1]) near each grid cell
+    std::vector<unsigned short> cell_segs[GRID * GRID];
+    // Sample nearest to each cell's centre, and the number of
+    // segments searched on each side of it for far-away points
+    unsigned short cell_near[GRID * GRID];
+    static const int REFINE = 8;
+
+    track_curve(vec2 o, bool closed, unsigned flags)
+      : track(o, 0, flags), closed(closed)
+      { }
+
+    // Takes a dense sampling of the curve by any parameter
+    void build(const std::vector<vec2> &dense) {
+      std::vector<float> cum(dense.size());
+      cum[0] = 0;
+      for (size_t i = 1; i < dense.size(); i++)
+        cum[i] = cum[i - 1] + (dense[i] - dense[i - 1]).norm();
+      len = cum.back();
+
+      size_t j = 0;
+      for (int i = 0; i <= N; i++) {
+        float s = len * i / N;
+        while (j + 2 < dense.size() && cum[j + 1] < s) j++;
+        float seg = cum[j + 1] - cum[j];
+        float u = (seg > 0 ? (s - cum[j]) / seg : 0);
+        if (u > 1) u = 1;
+        pts[i] = dense[j] + (dense[j + 1] - dense[j]) * u;
+      }
+      if (closed) pts[N] = pts[0];
+      for (int i = 0; i < N; i++) {
+        seg_d[i] = pts[i + 1] - pts[i];
+        float l2 = seg_d[i].dot(seg_d[i]);
+        seg_inv2[i] = (l2 > 0 ? 1 / l2 : 0);
+      }
+
+      vec2 lo = pts[0], hi = pts[0];
+      for (int i = 1; i <= N; i++) {
+        lo = vec2(fminf(lo.x, pts[i].x), fminf(lo.y, pts[i].y));
+        hi = vec2(fmaxf(hi.x, pts[i].x), fmaxf(hi.y, pts[i].y));
+      }
+      grid_lo = lo - vec2(MARGIN, MARGIN);
+      grid_cell = (hi - lo + vec2(MARGIN, MARGIN) * 2) / GRID;
+      // A segment within MARGIN of any point in a cell lies within
+      // MARGIN plus half the cell diagonal of its centre
+      float reach = MARGIN + grid_cell.norm() / 2;
+      for (int cy = 0; cy < GRID; cy++)
+        for (int cx = 0; cx < GRID; cx++) {
+          vec2 cen = grid_lo + grid_cell * vec2(cx + 0.5f, cy + 0.5f);
+          auto &list = cell_segs[cy * GRID + cx];
+          float near = 1e30f;
+          for (int i = 0; i < N; i++) {
+            float d = seg_dist2(i, cen).second;
+            if (d <= reach * reach) list.push_back(i);
+            if (d < near) { near = d; cell_near[cy * GRID + cx] = i; }
+          }
+        }
+    }
+
+    // <position along segment i in [0, 1], squared distance>
+    inline std::pair<float, float> seg_dist2(int i, vec2 p) const {
+      float u = (p - pts[i]).dot(seg_d[i]) * seg_inv2[i];
+      u = (u < 0 ? 0 : (u > 1 ? 1 : u));
+      vec2 e = p - (pts[i] + seg_d[i] * u);
+      return {u, e.dot(e)};
+    }
+
+    vec2 local_at(float t) const {
+      float x = t / len * N;
+      if (closed) x -= floorf(x / N) * N;
+      int i = (int)x;
+      if (i < 0) i = 0;
+      if (i > N - 1) i = N - 1;
+      return pts[i] + seg_d[i] * (x - i);
+    }
+    std::pair<float, float> local_nearest(vec2 p) const {
+      int best = -1;
+      std::pair<float, float> best_d(0, 1e30f);
+      vec2 c = vec2(
+        (p.x - grid_lo.x) / grid_cell.x,
+        (p.y - grid_lo.y) / grid_cell.y);
+      if (c.x >= 0 && c.x < GRID && c.y >= 0 && c.y < GRID) {
+        for (int i : cell_segs[(int)c.y * GRID + (int)c.x]) {
+          auto d = seg_dist2(i, p);
+          if (d.second < best_d.second) { best = i; best_d = d; }
+        }
+      }
+      // Farther than MARGIN from the curve: search around the sample
+      // nearest to the (clamped) cell's centre. This is approximate,
+      // but only picking uses distances this large
+      if (best_d.second > MARGIN * MARGIN) {
+        int cx = (c.x < 0 ? 0 : (c.x >= GRID ? GRID - 1 : (int)c.x));
+        int cy = (c.y < 0 ? 0 : (c.y >= GRID ? GRID - 1 : (int)c.y));
+        int k = cell_near[cy * GRID + cx];
+        for (int i = k - REFINE; i < k + REFINE; i++) {
+          int j = (closed ? (i + N) % N : i);
+          if (j < 0 || j >= N) continue;
+          auto d = seg_dist2(j, p);
+          if (d.second < best_d.second) { best = j; best_d = d; }
+        }
+      }
+      float t = (best + best_d.first) * len / N;
+      if (closed && t >= len) t -= len;
+      return {t, sqrtf(best_d.second)};
+    }
+
+    inline vec2 normal(int i) const {
+      int a = (i > 0 ? i - 1 : (closed ? N - 1 : 0));
+      int b = (i < N ? i + 1 : (closed ? 1 : N));
+      vec2 d = pts[b] - pts[a];
+      return (d / d.norm()).rot(M_PI / 2);
+    }
+    void polyline(float offs, rl::Color tint) const {
+      for (int i = 0; i < N; i++)
+        rl::DrawLineEx(
+          scr(o + pts[i] + normal(i) * offs),
+          scr(o + pts[i + 1] + normal(i + 1) * offs),
+          2, tint);
+    }
+    void draw(int T) const {
+      using namespace rl;
+      polyline(0, tint());
+
+      if (flags & FIXED) {
+        for (int i : {0, N}) {
+          if (closed && i == N) break;
+          vec2 n = normal(i);
+          DrawLineEx(
+            scr(o + pts[i] - n * 0.1), scr(o + pts[i] + n * 0.1),
+            2, tint());
+        }
+      }
+
+      float dist = 0, alpha = 0;
+      ripples(T, dist, alpha);
+      if (alpha > 0) {
+        polyline(dist, premul_alpha(tint(), alpha));
+        polyline(-dist, premul_alpha(tint(), alpha));
+      }
+    }
+  };
+
+  // Semi-axes `a` and `b`, turned by `rot` (radians)
+  struct track_ell : public track_curve {
+    float a, b, rot;
+    track_ell(vec2 o, float a, float b, unsigned flags = 0, float rot = 0)
+      : track_curve(o, true, flags), a(a), b(b), rot(rot)
+    {
+      std::vector<vec2> dense(4097);
+      for (int i = 0; i <= 4096; i++) {
+        float u = (float)i / 4096 * M_PI * 2;
+        dense[i] = vec2(a * cosf(u), b * sinf(u)).rot(rot);
+      }
+      build(dense);
+    }
+    track *clone() const { return new track_ell(*this); }
+    void write(std::string &s) const {
+      appendf(s, "T_ell(vec2(%.9g, %.9g), %.9g, %.9g, ", o.x, o.y, a, b);
+      write_flags(s);
+      appendf(s, ", %.9g)", rot);
+    }
+  };
+
+  // Cubic Bezier with control points relative to the origin
+  struct track_bez : public track_curve {
+    vec2 p[4];
+    track_bez(vec2 o, vec2 p0, vec2 p1, vec2 p2, vec2 p3, unsigned flags = 0)
+      : track_curve(o, false, flags), p{p0, p1, p2, p3}
+    {
+      std::vector<vec2> dense(4097);
+      for (int i = 0; i <= 4096; i++) {
+        float u = (float)i / 4096, v = 1 - u;
+        dense[i] = p0 * (v * v * v) + p1 * (3 * v * v * u) +
+          p2 * (3 * v * u * u) + p3 * (u * u * u);
+      }
+      build(dense);
+    }
+    track *clone() const { return new track_bez(*this); }
+    void write(std::string &s) const {
+      appendf(s, "T_bez(vec2(%.9g, %.9g)", o.x, o.y);
+      for (int i = 0; i < 4; i++)
+        appendf(s, ", vec2(%.9g, %.9g)", p[i].x, p[i].y);
+      s += ", ";
+      write_flags(s);
+      s += ")";
+    }
+  };
+
+  // Closed Catmull-Rom spline through points relative to the origin
+  struct track_spl : public track_curve {
+    std::vector<vec2> ctrl;
+    track_spl(vec2 o, const std::vector<vec2> &ctrl, unsigned flags = 0)
+      : track_curve(o, true, flags), ctrl(ctrl)
+    {
+      const int K = 512;  // Dense samples per span
+      int n = ctrl.size();
+      std::vector<vec2> dense;
+      dense.reserve(n * K + 1);
+      for (int s = 0; s < n; s++) {
+        vec2 a = ctrl[(s + n - 1) % n], b = ctrl[s];
+        vec2 c = ctrl[(s + 1) % n], d = ctrl[(s + 2) % n];
+        for (int i = 0; i < K; i++) {
+          float u = (float)i / K, u2 = u * u, u3 = u2 * u;
+          dense.push_back((
+            b * 2 + (c - a) * u +
+            (a * 2 - b * 5 + c * 4 - d) * u2 +
+            (b * 3 - a - c * 3 + d) * u3) * 0.5f);
+        }
+      }
+      dense.push_back(ctrl[0]);
+      build(dense);
+    }
+    track *clone() const { return new track_spl(*this); }
+    void write(std::string &s) const {
+      appendf(s, "T_spl(vec2(%.9g, %.9g), {", o.x, o.y);
+      for (size_t i = 0; i < ctrl.size(); i++)
+        appendf(s, "%svec2(%.9g, %.9g)", i == 0 ? "" : ", ",
+          ctrl[i].x, ctrl[i].y);
+      s += "}, ";
+      write_flags(s);
+      s += ")";
+    }
+  };
+
   // ==== Fireflies ===
   struct firefly {
     // Position (track + phase)
@@ -211,16 +540,24 @@ public:
         sel(false)
       { }
 
-    inline void update(const std::vector<track *> &tracks) {
+    // Returns the number of events (attaching to or returning from
+    // another track) handled, at most one. If `crossings` is given, the
+    // other collision tracks are checked too, and every one the step
+    // crossed is counted there, handled or not
+    inline int update(const std::vector<track *> &tracks,
+        int *crossings = nullptr) {
+      const track *own = tr;
+      int events = 0;
+      if (crossings != nullptr) *crossings = 0;
       float t_prev = t;
       vec2 p1 = pos();
       t += v / STEPS;
       if (t >= tr->len) t -= tr->len;
-      if (t < 0) t += tr->len;
+      if (t < 0) t = tr->phase(t + tr->len);
       vec2 p2 = pos();
 
       // Attracting tracks
-      for (const auto tr : tracks) if (tr != this->tr && (tr->flags & track::COLLI)) {
+      for (const auto tr : tracks) if (tr != own && (tr->flags & track::COLLI)) {
         auto near = tr->nearest(p1);
         if (near.second >= 0.01) continue;
         float t1 = near.first;
@@ -233,12 +570,14 @@ public:
         // Lemma: (p1, p2) crosses the curve C iff
         // (p1, p2) crosses (C(t1), C(t2))
         if (seg_intxn(p1, p2, tr->at(t1), tr->at(t2))) {
+          if (crossings != nullptr) ++*crossings;
+          if (events > 0) continue;
           // Point of intersection
           if (tr->flags & track::ATTRACT) {
             // Move to the new track
             this->tr = tr;
             // Take the later parameter to avoid recursion
-            this->t = t2;
+            this->t = tr->phase(t2);
             // Reverse if making acute turns
             if (this->v * (t2 - t1) < 0) this->v = -this->v;
           }
@@ -252,9 +591,11 @@ public:
             this->t = t_prev;
             this->v = -this->v;
           }
-          break;
+          events = 1;
+          if (crossings == nullptr) break;
         }
       }
+      return events;
     }
     inline void draw(int offs) const {
       using namespace rl;
@@ -262,12 +603,7 @@ public:
         (Color){255, 64, 64, 255} :
         (Color){255, 255, 16, 255});
       float alpha = 1.0/8 * (v < 1 ? 1 : v);
-      Color fade = (Color){
-        (unsigned char)(tint.r * alpha),
-        (unsigned char)(tint.g * alpha),
-        (unsigned char)(tint.b * alpha),
-        (unsigned char)(tint.a * alpha)
-      };
+      Color fade = premul_alpha(tint, alpha);
 
       DrawCircleV(scr(pos()), 4, tint);
       for (int i = 0; i < TRAIL_N; i++) {
@@ -340,10 +676,19 @@ public:
       since_on++;
       since_off++;
     }
-    virtual bool update(const std::vector<firefly> &fireflies) = 0;
+    // Advances by one step, given whether any firefly is within
+    virtual bool step(bool within) = 0;
+    bool update(const std::vector<firefly> &fireflies) {
+      return step(fireflies_within(fireflies));
+    }
     virtual void draw1(int finish_anim) const { }
     virtual void draw2(int finish_anim) const { }
 
+    virtual bellflower *clone() const = 0;
+    virtual void write(std::string &s) const = 0;
+    // State that affects future triggers, for loop detection
+    virtual int state() const { return last_on; }
+
     inline bool fireflies_within(const std::vector<firefly> &fireflies) {
       for (const auto f : fireflies)
         if ((f.pos() - o).norm() <= r) return true;
@@ -367,9 +712,12 @@ public:
     bellflower_ord(vec2 o, float r, int c0)
       : bellflower(o, r, c0)
       { }
-    bool update(const std::vector<firefly> &fireflies) {
-      bool on = fireflies_within(fireflies);
-      return bellflower::update(on);
+    bool step(bool within) {
+      return bellflower::update(within);
+    }
+    bellflower *clone() const { return new bellflower_ord(*this); }
+    void write(std::string &s) const {
+      appendf(s, "B_ord(vec2(%.9g, %.9g), %.9g, %d)", o.x, o.y, r, c0);
     }
     void draw1(int finish_anim) const {
       using namespace rl;
@@ -434,15 +782,20 @@ public:
       bellflower::reset();
       d = d0;
     }
-    bool update(const std::vector<firefly> &fireflies) {
-      bool on = fireflies_within(fireflies);
-      if (on) {
+    bool step(bool within) {
+      if (within) {
         if (d > 0) d--;
       } else {
         d = d0;
       }
       return bellflower::update(d == 0);
     }
+    bellflower *clone() const { return new bellflower_delay(*this); }
+    void write(std::string &s) const {
+      appendf(s, "B_delay(vec2(%.9g, %.9g), %.9g, %d, %.9g)",
+        o.x, o.y, r, c0, (float)d0 / STEPS);
+    }
+    int state() const { return last_on | (d << 1); }
     void draw1(int finish_anim) const {
       using namespace rl;
       DrawRing(scr(o), r * SCALE - 1, r * SCALE + 1, 0, 360, 48, (Color){64, 64, 64, 128});
@@ -454,6 +807,46 @@ public:
     }
   };
 
+  // ==== Stepping ====
+  // Fireflies never interact with each other, so large boards are stepped
+  // in ranges on workers. Each range marks the bellflowers it has fireflies
+  // within, and the marks are OR-ed into `on`; bellflowers are then updated
+  // in order by the caller, as with `bellflower::update()`
+  static const int PARALLEL_MIN = 1024;   // Fireflies
+  static void step_fireflies(
+    std::vector<firefly> &fireflies,
+    const std::vector<track *> &tracks,
+    const std::vector<bellflower *> &bellflowers,
+    std::vector<char> &on
+  ) {
+    int n = fireflies.size(), nb = bellflowers.size();
+    auto range = [&](int begin, int end, char *mark) {
+      for (int i = begin; i < end; i++) {
+        fireflies[i].update(tracks);
+        vec2 p = fireflies[i].pos();
+        for (int j = 0; j < nb; j++)
+          if (!mark[j] && (p - bellflowers[j]->o).norm() <= bellflowers[j]->r)
+            mark[j] = 1;
+      }
+    };
+    on.assign(nb, 0);
+    int parts = jobs::workers() + 1;
+    if (n < PARALLEL_MIN || parts == 1) {
+      range(0, n, on.data());
+      return;
+    }
+    std::vector<char> marks((size_t)parts * nb, 0);
+    std::vector<job_ref> runs;
+    for (int k = 1; k < parts; k++)
+      runs.push_back(jobs::run([&, k]() {
+        range((long)n * k / parts, (long)n * (k + 1) / parts, &marks[k * nb]);
+      }));
+    range(0, n / parts, &marks[0]);
+    for (const auto &j : runs) jobs::wait(j);
+    for (int k = 0; k < parts; k++)
+      for (int j = 0; j < nb; j++) on[j] |= marks[k * nb + j];
+  }
+
   // ==== Scene ====
   int T;  // Update counter. Overflows after 51 days but whatever
 
@@ -472,11 +865,15 @@ public:
   std::vector<track *> tracks;
   std::vector<firefly> fireflies, fireflies_init;
   std::vector<bellflower *> bellflowers;
-  std::vector<std::vector<std::pair<firefly *, float>>> ff_links;
+  std::vector<std::vector<int>> links;  // Groups of fireflies moved together
+  // Offsets of fireflies that move along with each one
+  typedef std::vector<std::vector<std::pair<firefly *, float>>> link_list;
+  link_list ff_links;
   std::vector<tutorial> tutorials;
   int to_text;
 
   float bellflowers_x_cen;  // Used for sounds
+  std::vector<char> bf_on;  // Bellflowers with fireflies within, per step
 
   firefly::trail_manager trail_m;
 
@@ -488,8 +885,10 @@ public:
   vec2 sel_offs;
   int run_state = (8 << 1); // Initial speed 8 steps/update
   int finish_timer = -1;
+  bool autoplay = false;  // Stays on the board after finishing
 
-  // Scaling factor for render targets
+  // Scaling factor for render targets; the base one follows the
+  // offscreen target being drawn to when that is larger
   const float RT_SCALE_BASE = 2;
   const float RT_SCALE_BLOOM =
 #ifdef SHOWCASE
@@ -499,8 +898,13 @@ public:
 #endif
   ;
   rl::RenderTexture2D texBloomBase, texBloomStage1, texBloomStage2;
+  float rt_scale_base = 0;  // Of texBloomBase
   rl::Shader shaderBloom;
   int shaderBloomPassLoc;
+#ifdef SHOWCASE
+  rl::Shader shaderBloomRef = {};   // Loaded on first use
+  int shaderBloomRefPassLoc;
+#endif
 
   rl::Shader shaderSpotlight;
   int shaderSpotlightCenLoc, shaderSpotlightRadLoc;
@@ -511,6 +915,7 @@ public:
     float rot_cen, rot_amp, rot_period;
     float tint;
   } trees[BG_TREES_N];
+  job_ref trees_job;  // Layout, waited for before the first draw
 
   button_group buttons;
 
@@ -532,19 +937,9 @@ public:
     }};
     update_buttons_images();
 
-    to_text = -1;
-
-    std::vector<std::vector<int>> links;
-    switch (puzzle_id) {
-      #define T_cir   new track_cir
-      #define T_seg   new track_seg
-      #define B_ord   new bellflower_ord
-      #define B_delay new bellflower_delay
-      #define F(_i, _t, ...) \
-        firefly(tracks[_i], tracks[_i]->len * (_t), __VA_ARGS__)
-      #include "puzzles.hh"
-    }
-    build_links(links);
+    load_puzzle(puzzle_id, title, tracks, fireflies, bellflowers,
+      links, tutorials, to_text);
+    build_links(fireflies, links, ff_links);
 
     float x_sum = 0;
     for (auto b : bellflowers) x_sum += b->o.x;
@@ -559,15 +954,15 @@ public:
     update_tut_show_range(true);
     tut_hide_time = -1;
 
-    texBloomBase = rl::LoadRenderTexture(W * RT_SCALE_BASE, H * RT_SCALE_BASE);
-    rl::SetTextureFilter(texBloomBase.texture, rl::TEXTURE_FILTER_BILINEAR);
-    rl::SetTextureWrap(texBloomBase.texture, rl::TEXTURE_WRAP_CLAMP);
+    load_base_target(RT_SCALE_BASE);
     texBloomStage1 = rl::LoadRenderTexture(W * RT_SCALE_BLOOM, H * RT_SCALE_BLOOM);
     rl::SetTextureFilter(texBloomStage1.texture, rl::TEXTURE_FILTER_BILINEAR);
     rl::SetTextureWrap(texBloomStage1.texture, rl::TEXTURE_WRAP_CLAMP);
     texBloomStage2 = rl::LoadRenderTexture(W * RT_SCALE_BLOOM, H * RT_SCALE_BLOOM);
     rl::SetTextureFilter(texBloomStage2.texture, rl::TEXTURE_FILTER_BILINEAR);
     rl::SetTextureWrap(texBloomStage2.texture, rl::TEXTURE_WRAP_CLAMP);
+    for (auto rt : {texBloomStage1, texBloomStage2})
+      memstat::add(memstat::RENDER_TARGET, memstat::rt_size(rt));
   #ifdef PLATFORM_WEB
     shaderBloom = rl::LoadShader("res/bloom_web.vert", "res/bloom_web.frag");
     shaderSpotlight = rl::LoadShader("res/spotlight_web.vert", "res/spotlight_web.frag");
@@ -596,6 +991,11 @@ public:
         .tint = (192 + ((rands[4] >> 16) % 32)) / 255.0f,
       };
     }
+    trees_job = jobs::run([this]() { this->layout_trees(); });
+  }
+
+  // Spreads the trees apart
+  void layout_trees() {
     for (int it = 0; it < 1000; it++) {
       for (int i = 0; i < BG_TREES_N; i++) {
         vec2 move = vec2(0, 0);
@@ -614,19 +1014,160 @@ public:
   }
 
   ~scene_game() {
+#ifdef EDITOR
+    ed_stop_solver();
+#endif
+    jobs::wait(trees_job);
+    for (auto rt : {texBloomBase, texBloomStage1, texBloomStage2})
+      memstat::sub(memstat::RENDER_TARGET, memstat::rt_size(rt));
     rl::UnloadRenderTexture(texBloomBase);
     rl::UnloadRenderTexture(texBloomStage1);
     rl::UnloadRenderTexture(texBloomStage2);
     rl::UnloadShader(shaderBloom);
+#ifdef SHOWCASE
+    if (shaderBloomRef.id != 0) rl::UnloadShader(shaderBloomRef);
+#endif
     rl::UnloadShader(shaderSpotlight);
     for (auto t : tracks) delete t;
     for (auto b : bellflowers) delete b;
   }
 
-  inline void build_links(std::vector<std::vector<int>> links) {
+  void load_base_target(float scale) {
+    if (rt_scale_base != 0) {
+      memstat::sub(memstat::RENDER_TARGET, memstat::rt_size(texBloomBase));
+      rl::UnloadRenderTexture(texBloomBase);
+    }
+    texBloomBase = rl::LoadRenderTexture(W * scale, H * scale);
+    rl::SetTextureFilter(texBloomBase.texture, rl::TEXTURE_FILTER_BILINEAR);
+    rl::SetTextureWrap(texBloomBase.texture, rl::TEXTURE_WRAP_CLAMP);
+    memstat::add(memstat::RENDER_TARGET, memstat::rt_size(texBloomBase));
+    rt_scale_base = scale;
+  }
+
+  // Contents of a puzzle as listed in puzzles.hh
+  static void load_puzzle(int puzzle_id,
+    const char *&title,
+    std::vector<track *> &tracks,
+    std::vector<firefly> &fireflies,
+    std::vector<bellflower *> &bellflowers,
+    std::vector<std::vector<int>> &links,
+    std::vector<tutorial> &tutorials,
+    int &to_text
+  ) {
+    title = "";
+    to_text = -1;
+    switch (puzzle_id) {
+      #define T_cir   new track_cir
+      #define T_seg   new track_seg
+      #define T_ell   new track_ell
+      #define T_bez   new track_bez
+      #define T_spl   new track_spl
+      #define B_ord   new bellflower_ord
+      #define B_delay new bellflower_delay
+      #define F(_i, _t, ...) \
+        firefly(tracks[_i], tracks[_i]->len * (_t), __VA_ARGS__)
+      #include "puzzles.hh"
+    }
+  }
+  // Whether puzzles.hh has a board numbered so
+  static bool has_puzzle(int puzzle_id) {
+    const char *title;
+    std::vector<track *> tracks;
+    std::vector<firefly> fireflies;
+    std::vector<bellflower *> bellflowers;
+    std::vector<std::vector<int>> links;
+    std::vector<tutorial> tutorials;
+    int to_text;
+    load_puzzle(puzzle_id, title, tracks, fireflies, bellflowers,
+      links, tutorials, to_text);
+    bool found = !tracks.empty();
+    for (auto t : tracks) delete t;
+    for (auto b : bellflowers) delete b;
+    return found;
+  }
+
+  // Board in the format of puzzles.hh
+  static std::string puzzle_text(
+    const std::vector<track *> &tracks,
+    const std::vector<firefly> &fireflies,
+    const std::vector<bellflower *> &bellflowers,
+    const std::vector<std::vector<int>> &links
+  ) {
+    std::string s = "  tracks = {\n";
+    for (const auto t : tracks) {
+      s += "    ";
+      t->write(s);
+      s += ",\n";
+    }
+    s += "  };\n  fireflies = {\n";
+    for (const auto &f : fireflies) {
+      int i = 0;
+      while (tracks[i] != f.tr) i++;
+      appendf(s, "    F(%d, %.9g, %.9g),\n", i, f.t / f.tr->len, f.v);
+    }
+    s += "  };\n  bellflowers = {\n";
+    for (const auto b : bellflowers) {
+      s += "    ";
+      b->write(s);
+      s += ",\n";
+    }
+    s += "  };\n";
+    if (!links.empty()) {
+      s += "  links = {\n";
+      for (const auto &group : links) {
+        s += "    {";
+        for (size_t i = 0; i < group.size(); i++)
+          appendf(s, "%s%d", i == 0 ? "" : ", ", group[i]);
+        s += "},\n";
+      }
+      s += "  };\n";
+    }
+    return s;
+  }
+
+  // Dynamic state of fireflies, exactly: one line of
+  // <track index> <phase> <velocity> each, floats in hexadecimal
+  static std::string state_text(
+    const std::vector<track *> &tracks,
+    const std::vector<firefly> &fireflies
+  ) {
+    std::string s;
+    for (const auto &f : fireflies) {
+      int i = 0;
+      while (tracks[i] != f.tr) i++;
+      appendf(s, "%d %a %a\n", i, f.t, f.v);
+    }
+    return s;
+  }
+  // Restores what `state_text()` wrote into fireflies of the same board;
+  // returns false if the text does not describe them
+  static bool load_state(const char *s,
+    const std::vector<track *> &tracks,
+    std::vector<firefly> &fireflies
+  ) {
+    for (auto &f : fireflies) {
+      char *end;
+      long i = strtol(s, &end, 10);
+      if (end == s || i < 0 || i >= (long)tracks.size()) return false;
+      s = end;
+      float t = strtof(s, &end);
+      if (end == s) return false;
+      s = end;
+      float v = strtof(s, &end);
+      if (end == s) return false;
+      s = end;
+      f.tr = tracks[i];
+      f.t = t;
+      f.v = v;
+    }
+    return true;
+  }
+
+  static void build_links(std::vector<firefly> &fireflies,
+      const std::vector<std::vector<int>> &links, link_list &ff_links) {
     ff_links.clear();
     ff_links.resize(fireflies.size());
-    for (const auto group : links) {
+    for (const auto &group : links) {
       for (const auto indep : group) {
         auto &list = ff_links[indep];
         float t = fireflies[indep].t;
@@ -639,6 +1180,186 @@ public:
       }
     }
   }
+  // Moves the fireflies linked to one that has been moved
+  static void move_links(const link_list &ff_links, int index, const firefly &f) {
+    for (const auto link : ff_links[index]) {
+      link.first->t =
+        (link.first->v * f.v < 0) ?
+          link.second - f.t :
+          link.second + f.t;
+    }
+  }
+
+  // ==== Headless evaluation ====
+  // A copy of a board, run without display, sound or input
+  struct board_sim {
+    std::vector<track *> tracks;
+    std::vector<firefly> fireflies, fireflies_init;
+    std::vector<bellflower *> bellflowers;
+    std::vector<std::vector<int>> links;
+    link_list ff_links;
+    uint64_t level;   // Hash of the board, as part of cache keys
+    // Parameters set by the player: origins of movable tracks, and
+    // phases of fireflies that do not follow an earlier one
+    std::vector<track *> free_tracks;
+    std::vector<int> free_fireflies;
+    static constexpr float QUANTUM = 0.01;
+    std::vector<float> phases;  // Initial phases of all fireflies
+    std::vector<char> on;
+
+    board_sim(
+      const std::vector<track *> &tracks,
+      const std::vector<firefly> &fireflies,
+      const std::vector<bellflower *> &bellflowers,
+      const std::vector<std::vector<int>> &links
+    ) {
+      for (const auto t : tracks) this->tracks.push_back(t->clone());
+      for (auto f : fireflies) {
+        int i = 0;
+        while (tracks[i] != f.tr) i++;
+        f.tr = this->tracks[i];
+        this->fireflies.push_back(f);
+      }
+      for (const auto b : bellflowers) this->bellflowers.push_back(b->clone());
+      this->links = links;
+      build_links(this->fireflies, links, ff_links);
+      fireflies_init = this->fireflies;
+
+      for (auto t : this->tracks)
+        if (!(t->flags & track::FIXED)) free_tracks.push_back(t);
+      std::vector<bool> follows(this->fireflies.size(), false);
+      for (size_t i = 0; i < this->fireflies.size(); i++) if (!follows[i]) {
+        free_fireflies.push_back(i);
+        for (const auto &link : ff_links[i])
+          follows[link.first - &this->fireflies[0]] = true;
+      }
+
+      // Only what `set_config()` keeps identifies the level: with every
+      // parameter at zero, followers sit at their offsets from leaders
+      set_config(std::vector<int>(free_tracks.size() * 2 + free_fireflies.size(), 0));
+      std::string text = puzzle_text(this->tracks, this->fireflies,
+        this->bellflowers, links);
+      level = hash64(text.data(), text.size());
+    }
+    board_sim(const board_sim &) = delete;
+    ~board_sim() {
+      for (auto t : tracks) delete t;
+      for (auto b : bellflowers) delete b;
+    }
+
+    // Sets the free parameters, given in multiples of QUANTUM
+    void set_config(const std::vector<int> &q) {
+      fireflies = fireflies_init;
+      int k = 0;
+      for (auto t : free_tracks) {
+        t->o = vec2(q[k] * QUANTUM, q[k + 1] * QUANTUM);
+        k += 2;
+      }
+      for (int i : free_fireflies) {
+        fireflies[i].t = q[k++] * QUANTUM;
+        move_links(ff_links, i, fireflies[i]);
+      }
+      phases.resize(fireflies.size());
+      for (size_t i = 0; i < fireflies.size(); i++) phases[i] = fireflies[i].t;
+    }
+
+    inline uint64_t fingerprint() const {
+      uint64_t h = hash64(nullptr, 0);
+      for (const auto &f : fireflies) {
+        long s[3] = {(long)(uintptr_t)f.tr, lroundf(f.t * 1e4f), f.v > 0};
+        h = hash64(s, sizeof s, h);
+      }
+      for (const auto b : bellflowers) {
+        int s = b->state();
+        h = hash64(&s, sizeof s, h);
+      }
+      return h;
+    }
+
+    // Runs until all bellflowers reach zero, any goes below zero,
+    // the board cycles with no trigger in between, or `max_steps` pass.
+    // Fingerprints only match to their precision, so a repeat counts
+    // as a cycle once one more whole period repeats with the same gap
+    eval_outcome run(int max_steps) {
+      for (auto b : bellflowers) b->reset();
+      eval_outcome o = {};
+      // Last step of each fingerprint seen since the last trigger
+      std::unordered_map<uint64_t, int> seen;
+      int period = 0, confirm_end = 0;
+      for (o.steps = 1; o.steps < max_steps; o.steps++) {
+        step_fireflies(fireflies, tracks, bellflowers, on);
+        bool triggered = false, negative = false, zero = true;
+        for (size_t i = 0; i < bellflowers.size(); i++) {
+          bellflower *b = bellflowers[i];
+          if (b->step(on[i])) triggered = true;
+          if (b->c < 0) negative = true;
+          if (b->c != 0) zero = false;
+        }
+        if (zero) { o.solved = 1; break; }
+        if (negative) break;
+        if (triggered) { seen.clear(); period = 0; continue; }
+        auto ins = seen.insert({fingerprint(), o.steps});
+        int gap = (ins.second ? 0 : o.steps - ins.first->second);
+        ins.first->second = o.steps;
+        if (gap == 0 || gap != period) {
+          period = gap;
+          confirm_end = o.steps + gap;
+        } else if (o.steps == confirm_end) {
+          o.period = period;
+          break;
+        }
+      }
+      for (size_t i = 0; i < 8 && i < bellflowers.size(); i++)
+        o.counts[i] = bellflowers[i]->c;
+      return o;
+    }
+
+    static const int MAX_STEPS = STEPS * 60;
+
+    static inline float rnd(unsigned &seed) {
+      seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+      return (float)seed / (float)0x7fffffff;
+    }
+    // Random free parameters, with tracks anywhere on the board
+    void sample(unsigned &seed, std::vector<int> &q) const {
+      q.clear();
+      for (size_t i = 0; i < free_tracks.size(); i++) {
+        q.push_back(lroundf((rnd(seed) - 0.5f) * BOARD_W / QUANTUM));
+        q.push_back(lroundf((rnd(seed) - 0.5f) * BOARD_H / QUANTUM));
+      }
+      for (int i : free_fireflies)
+        q.push_back((int)(rnd(seed) * fireflies_init[i].tr->len / QUANTUM));
+    }
+    // Outcome of an arrangement, from the cache if known.
+    // Cycles are only found to the fingerprint's precision, so runs
+    // ended by one are not kept: a false one would persist
+    eval_outcome evaluate(const std::vector<int> &q, bool *cached = nullptr) {
+      int max_steps = MAX_STEPS;
+      uint64_t key = hash64(&max_steps, sizeof max_steps, level);
+      key = hash64(q.data(), q.size() * sizeof(int), key);
+      eval_outcome o;
+      bool hit = eval_cache::lookup(key, o);
+      if (!hit) {
+        set_config(q);
+        o = run(max_steps);
+        if (o.period == 0) eval_cache::store(key, o);
+      }
+      if (cached != nullptr) *cached = hit;
+      return o;
+    }
+
+    // Current configuration as a screenshot name (see `scr()`)
+    std::string name(int puzzle_id) const {
+      std::string s;
+      appendf(s, "%02d", puzzle_id);
+      for (const auto t : free_tracks)
+        appendf(s, "_%ld_%ld", lroundf(t->o.x * 10000), lroundf(t->o.y * 10000));
+      for (float t : phases)
+        appendf(s, "_%ld", lroundf(t * 10000));
+      s += ".png";
+      return s;
+    }
+  };
 
   inline bool tut_has_next() const {
     return (tut_show_start < tutorials.size() &&
@@ -690,10 +1411,16 @@ public:
     return {best_ff, best_track};
   }
 
+  const char *name() { return "game"; }
+  int speed() { return (run_state & 1) ? (run_state >> 1) : 0; }
+
   void pton(float x, float y) {
     if (tut_has_next() && !tut_allows_interaction()) return;
     if (buttons.pton(x, y)) return;
     if (run_state & 1) return;
+#ifdef EDITOR
+    if (editing) { ed_pton(board(x, y)); return; }
+#endif
 
     vec2 p = board(x, y);
 
@@ -713,18 +1440,15 @@ public:
   void ptmove(float x, float y) {
     if (tut_has_next() && !tut_allows_interaction()) return;
     if (buttons.ptmove(x, y)) return;
+#ifdef EDITOR
+    if (editing) { ed_ptmove(board(x, y)); return; }
+#endif
 
     vec2 p = board(x, y);
     if (sel_ff != nullptr) {
       sel_ff->t = sel_ff->tr->nearest(p + sel_offs).first;
       // Move linked fireflies
-      int index = sel_ff - &fireflies[0];
-      for (const auto link : ff_links[index]) {
-        link.first->t =
-          (link.first->v * sel_ff->v < 0) ?
-            link.second - sel_ff->t :
-            link.second + sel_ff->t;
-      }
+      move_links(ff_links, sel_ff - &fireflies[0], *sel_ff);
       trail_m.recalc_init();
     }
     if (sel_track != nullptr) {
@@ -737,6 +1461,9 @@ public:
     if (tut_has_next() && tut_hide_time == -1)
       tut_hide_time = T;
     if (buttons.ptoff(x, y)) return;
+#ifdef EDITOR
+    if (editing) { ed_ptoff(); return; }
+#endif
 
     if (sel_ff != nullptr) {
       sel_ff->sel = false;
@@ -748,6 +1475,410 @@ public:
     }
   }
 
+#ifdef EDITOR
+  // ==== Editor ====
+  // E toggles editing. Keys act on the item under the pointer:
+  // C/S add a circle/segment, F adds a firefly on the nearest track,
+  // B adds a bellflower, X deletes; 1/2/3 toggle attracting/returning/
+  // fixed; [/] resize, ,/. rotate tracks; Up/Down change counts and
+  // speeds; L links two fireflies in turn; P saves; N clears the board
+  bool editing = false;
+  bool ed_keys_down[400] = { };
+  inline bool ed_key(int key) {
+    bool down = rl::IsKeyDown(key);
+    bool pressed = (down && !ed_keys_down[key]);
+    ed_keys_down[key] = down;
+    return pressed;
+  }
+
+  enum { ED_NONE, ED_TRACK, ED_FIREFLY, ED_BELLFLOWER };
+  struct ed_item { int kind, index; };
+  ed_item ed_sel = {ED_NONE, -1};
+  vec2 ed_offs;
+  bool ed_moved = false;
+  int ed_link_from = -1;
+  const char *ed_msg = nullptr;
+  int ed_msg_time;
+
+  inline ed_item ed_pick(vec2 p) const {
+    for (int i = 0; i < (int)fireflies.size(); i++)
+      if ((fireflies[i].pos() - p).norm() < 0.5) return {ED_FIREFLY, i};
+    for (int i = 0; i < (int)bellflowers.size(); i++)
+      if ((bellflowers[i]->o - p).norm() < 1) return {ED_BELLFLOWER, i};
+    ed_item best = {ED_NONE, -1};
+    float best_dist = 0.5;
+    for (int i = 0; i < (int)tracks.size(); i++) {
+      float dist = tracks[i]->nearest(p).second;
+      if (dist < best_dist) { best_dist = dist; best = {ED_TRACK, i}; }
+    }
+    return best;
+  }
+
+  void ed_toggle() {
+    if (run_state & 1) {
+      run_state &= ~1;
+      stop_run();
+    }
+    finish_timer = -1;
+    editing = !editing;
+    if (editing) {
+      tutorials = {};
+      update_tut_show_range(true);
+      eval_cache::open("eval_cache.bin", EVAL_CACHE_SIZE);
+      ed_changed();
+    } else {
+      ed_stop_solver();
+    }
+  }
+
+  // Rebuilds what depends on the board, and restarts the solver
+  void ed_changed() {
+    build_links(fireflies, links, ff_links);
+    trail_m.recalc_init();
+    float x_sum = 0;
+    for (auto b : bellflowers) x_sum += b->o.x;
+    bellflowers_x_cen = (bellflowers.empty() ? 0 : x_sum / bellflowers.size());
+    ed_start_solver();
+  }
+
+  void ed_replace_track(int i, track *t) {
+    track *old = tracks[i];
+    for (auto &f : fireflies) if (f.tr == old) {
+      f.tr = t;
+      f.t = f.t / old->len * t->len;
+    }
+    tracks[i] = t;
+    delete old;
+  }
+  void ed_remove_firefly(int i) {
+    fireflies.erase(fireflies.begin() + i);
+    for (auto &group : links) {
+      group.erase(std::remove(group.begin(), group.end(), i), group.end());
+      for (int &j : group) if (j > i) j--;
+    }
+    links.erase(std::remove_if(links.begin(), links.end(),
+      [](const std::vector<int> &group) { return group.size() < 2; }),
+      links.end());
+  }
+  void ed_remove_track(int i) {
+    for (int j = fireflies.size() - 1; j >= 0; j--)
+      if (fireflies[j].tr == tracks[i]) ed_remove_firefly(j);
+    delete tracks[i];
+    tracks.erase(tracks.begin() + i);
+  }
+  // Links fireflies a and b, or unlinks b if they already are
+  void ed_link(int a, int b) {
+    int ga = -1, gb = -1;
+    for (int k = 0; k < (int)links.size(); k++)
+      for (int j : links[k]) {
+        if (j == a) ga = k;
+        if (j == b) gb = k;
+      }
+    if (ga != -1 && ga == gb) {
+      auto &group = links[ga];
+      group.erase(std::remove(group.begin(), group.end(), b), group.end());
+      if (group.size() < 2) links.erase(links.begin() + ga);
+    } else if (ga == -1 && gb == -1) {
+      links.push_back({a, b});
+    } else if (gb == -1) {
+      links[ga].push_back(b);
+    } else if (ga == -1) {
+      links[gb].push_back(a);
+    } else {
+      links[ga].insert(links[ga].end(), links[gb].begin(), links[gb].end());
+      links.erase(links.begin() + gb);
+    }
+  }
+
+  // A copy of a track grown by `size` in extent and turned by `rot`
+  // about its origin, or nullptr if it would become too small.
+  // Curves are scaled so that their farthest point moves by `size`
+  static track *ed_transform(const track *t, float size, float rot) {
+    if (auto c = dynamic_cast<const track_cir *>(t)) {
+      if (c->r + size < 0.5) return nullptr;
+      return new track_cir(
+        c->o, c->r + size, c->flags, c->fix_angle + rot, c->fix_count);
+    }
+    if (auto g = dynamic_cast<const track_seg *>(t)) {
+      float half = g->len / 2 + size;
+      if (half < 0.5) return nullptr;
+      return new track_seg(g->o, (g->ext * half).rot(rot), g->flags);
+    }
+    if (auto e = dynamic_cast<const track_ell *>(t)) {
+      if (e->a + size < 0.5 || e->b + size < 0.5) return nullptr;
+      return new track_ell(e->o, e->a + size, e->b + size, e->flags, e->rot + rot);
+    }
+    auto bez = dynamic_cast<const track_bez *>(t);
+    auto spl = dynamic_cast<const track_spl *>(t);
+    if (bez == nullptr && spl == nullptr) return nullptr;
+    std::vector<vec2> pts = (bez != nullptr ?
+      std::vector<vec2>(bez->p, bez->p + 4) : spl->ctrl);
+    float ext = 0;
+    for (vec2 p : pts) ext = fmaxf(ext, p.norm());
+    if (ext + size < 0.5) return nullptr;
+    float k = (ext > 0 ? (ext + size) / ext : 1);
+    for (vec2 &p : pts) p = (p * k).rot(rot);
+    if (bez != nullptr)
+      return new track_bez(t->o, pts[0], pts[1], pts[2], pts[3], t->flags);
+    return new track_spl(t->o, pts, t->flags);
+  }
+
+  void ed_update() {
+    rl::Vector2 m = rl::GetMousePosition();
+    vec2 p = board(m.x, m.y);
+    ed_item it = ed_pick(p);
+    bool changed = false;
+
+    if (ed_key(rl::KEY_C)) {
+      tracks.push_back(new track_cir(p, 2));
+      changed = true;
+    }
+    if (ed_key(rl::KEY_S)) {
+      tracks.push_back(new track_seg(p, vec2(2, 0)));
+      changed = true;
+    }
+    if (ed_key(rl::KEY_F) && !tracks.empty()) {
+      int best = 0;
+      for (int i = 1; i < (int)tracks.size(); i++)
+        if (tracks[i]->nearest(p).second < tracks[best]->nearest(p).second)
+          best = i;
+      fireflies.push_back(firefly(tracks[best], tracks[best]->nearest(p).first, 1));
+      changed = true;
+    }
+    if (ed_key(rl::KEY_B)) {
+      bellflowers.push_back(new bellflower_ord(p, 2, 1));
+      changed = true;
+    }
+    if (ed_key(rl::KEY_X)) {
+      if (it.kind == ED_TRACK) ed_remove_track(it.index);
+      if (it.kind == ED_FIREFLY) ed_remove_firefly(it.index);
+      if (it.kind == ED_BELLFLOWER) {
+        delete bellflowers[it.index];
+        bellflowers.erase(bellflowers.begin() + it.index);
+      }
+      ed_link_from = -1;
+      changed = (it.kind != ED_NONE);
+      // Indices past the removed item have shifted
+      it = {ED_NONE, -1};
+    }
+
+    if (it.kind == ED_TRACK) {
+      track *t = tracks[it.index];
+      int flag_keys[3] = {rl::KEY_ONE, rl::KEY_TWO, rl::KEY_THREE};
+      unsigned flag_vals[3] = {track::ATTRACT, track::RETURN, track::FIXED};
+      for (int k = 0; k < 3; k++)
+        if (ed_key(flag_keys[k])) {
+          t->flags ^= flag_vals[k];
+          // Collisions are either attracting or returning
+          if (flag_vals[k] != track::FIXED) t->flags &= ~(track::COLLI ^ flag_vals[k]);
+          changed = true;
+        }
+      float size = 0, rot = 0;
+      if (ed_key(rl::KEY_LEFT_BRACKET)) size = -0.5;
+      if (ed_key(rl::KEY_RIGHT_BRACKET)) size = 0.5;
+      if (ed_key(rl::KEY_COMMA)) rot = -M_PI / 12;
+      if (ed_key(rl::KEY_PERIOD)) rot = M_PI / 12;
+      if (size != 0 || rot != 0) {
+        track *r = ed_transform(t, size, rot);
+        if (r != nullptr) {
+          ed_replace_track(it.index, r);
+          changed = true;
+        }
+      }
+    }
+    if (it.kind == ED_BELLFLOWER) {
+      bellflower *b = bellflowers[it.index];
+      int dc = (ed_key(rl::KEY_UP) ? 1 : 0) - (ed_key(rl::KEY_DOWN) ? 1 : 0);
+      if (dc != 0 && b->c0 + dc >= 1) {
+        b->c0 += dc;
+        b->reset();
+        changed = true;
+      }
+      float dr = (ed_key(rl::KEY_RIGHT_BRACKET) ? 0.5 : 0) -
+        (ed_key(rl::KEY_LEFT_BRACKET) ? 0.5 : 0);
+      if (dr != 0 && b->r + dr >= 0.5) {
+        b->r += dr;
+        changed = true;
+      }
+    }
+    if (it.kind == ED_FIREFLY) {
+      firefly &f = fireflies[it.index];
+      float dv = (ed_key(rl::KEY_UP) ? 0.5 : 0) - (ed_key(rl::KEY_DOWN) ? 0.5 : 0);
+      if (dv != 0 && fabsf(f.v + dv) <= 2) {
+        f.v += dv;
+        if (f.v == 0) f.v += dv;
+        changed = true;
+      }
+      if (ed_key(rl::KEY_L)) {
+        if (ed_link_from == -1) {
+          ed_link_from = it.index;
+        } else {
+          if (ed_link_from != it.index) ed_link(ed_link_from, it.index);
+          ed_link_from = -1;
+          changed = true;
+        }
+      }
+    }
+
+    if (ed_key(rl::KEY_N)) {
+      for (auto t : tracks) delete t;
+      for (auto b : bellflowers) delete b;
+      tracks.clear();
+      fireflies.clear();
+      bellflowers.clear();
+      links.clear();
+      ed_link_from = -1;
+      changed = true;
+    }
+    if (ed_key(rl::KEY_P)) ed_save();
+
+    if (changed) {
+      ed_sel = {ED_NONE, -1};
+      ed_changed();
+    }
+  }
+
+  void ed_pton(vec2 p) {
+    ed_sel = ed_pick(p);
+    ed_moved = false;
+    if (ed_sel.kind == ED_TRACK) {
+      tracks[ed_sel.index]->sel = true;
+      ed_offs = tracks[ed_sel.index]->o - p;
+    } else if (ed_sel.kind == ED_FIREFLY) {
+      fireflies[ed_sel.index].sel = true;
+      ed_offs = fireflies[ed_sel.index].pos() - p;
+    } else if (ed_sel.kind == ED_BELLFLOWER) {
+      ed_offs = bellflowers[ed_sel.index]->o - p;
+    }
+  }
+  void ed_ptmove(vec2 p) {
+    vec2 q = p + ed_offs;
+    if (ed_sel.kind == ED_TRACK) {
+      vec2 &o = tracks[ed_sel.index]->o;
+      if (o.x != q.x || o.y != q.y) ed_moved = true;
+      o = q;
+    } else if (ed_sel.kind == ED_FIREFLY) {
+      firefly &f = fireflies[ed_sel.index];
+      float t = f.tr->nearest(q).first;
+      if (f.t != t) ed_moved = true;
+      f.t = t;
+      move_links(ff_links, ed_sel.index, f);
+    } else if (ed_sel.kind == ED_BELLFLOWER) {
+      vec2 &o = bellflowers[ed_sel.index]->o;
+      if (o.x != q.x || o.y != q.y) ed_moved = true;
+      o = q;
+    }
+    trail_m.recalc_init();
+  }
+  void ed_ptoff() {
+    if (ed_sel.kind == ED_NONE) return;
+    if (ed_sel.kind == ED_TRACK) tracks[ed_sel.index]->sel = false;
+    if (ed_sel.kind == ED_FIREFLY) fireflies[ed_sel.index].sel = false;
+    ed_sel = {ED_NONE, -1};
+    // A click without a drag leaves the puzzle as it was
+    if (ed_moved) ed_changed();
+  }
+
+  void ed_save() {
+    static char path[32];
+    snprintf(path, sizeof path, "puzzle_%02d.txt", puzzle_id);
+    FILE *f = fopen(path, "w");
+    if (f == nullptr) {
+      ed_msg = "Cannot save";
+    } else {
+      fprintf(f, "case %d:\n  title = \"%s\";\n%s  break;\n", puzzle_id, title,
+        puzzle_text(tracks, fireflies, bellflowers, links).c_str());
+      fclose(f);
+      ed_msg = path;
+    }
+    ed_msg_time = T;
+  }
+
+  // Samples arrangements in jobs that reschedule themselves until
+  // cancelled by an edit or enough samples are taken. Levels seen
+  // before (e.g. after undoing a move) are answered from the cache
+  struct ed_solver {
+    board_sim base;
+    std::atomic<bool> cancel;
+    std::atomic<long> n_samples, n_solved;
+    ed_solver(
+      const std::vector<track *> &tracks,
+      const std::vector<firefly> &fireflies,
+      const std::vector<bellflower *> &bellflowers,
+      const std::vector<std::vector<int>> &links
+    ) : base(tracks, fireflies, bellflowers, links),
+        cancel(false), n_samples(0), n_solved(0)
+      { }
+  };
+  std::shared_ptr<ed_solver> solver;
+  static const int ED_SAMPLES_PROOF = 5000;   // Before calling it unsolvable
+  static const int ED_SAMPLES_MAX = 50000;
+
+  static void ed_solve_slice(std::shared_ptr<ed_solver> s, unsigned seed) {
+    if (s->cancel || s->n_samples >= ED_SAMPLES_MAX) return;
+    // Without workers, slices run on the main thread between frames
+    bool on_main = (jobs::workers() == 0);
+    double budget = (on_main ? 0.004 : 0.05);
+    board_sim sim(s->base.tracks, s->base.fireflies_init,
+      s->base.bellflowers, s->base.links);
+    std::vector<int> q;
+    auto start = std::chrono::steady_clock::now();
+    do {
+      sim.sample(seed, q);
+      if (sim.evaluate(q).solved) s->n_solved++;
+      s->n_samples++;
+    } while (!s->cancel && std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count() < budget);
+    auto next = [s, seed]() { ed_solve_slice(s, seed); };
+    if (on_main) jobs::run_main(next); else jobs::run(next);
+  }
+  void ed_start_solver() {
+    ed_stop_solver();
+    if (bellflowers.empty()) return;
+    solver = std::make_shared<ed_solver>(tracks, fireflies, bellflowers, links);
+    int n = (jobs::workers() > 0 ? jobs::workers() : 1);
+    for (int i = 0; i < n; i++) {
+      auto s = solver;
+      unsigned seed = 20220910 + i * 7919;
+      auto first = [s, seed]() { ed_solve_slice(s, seed); };
+      if (jobs::workers() == 0) jobs::run_main(first); else jobs::run(first);
+    }
+  }
+  void ed_stop_solver() {
+    if (solver != nullptr) solver->cancel = true;
+    solver = nullptr;
+  }
+
+  void ed_draw() {
+    using namespace rl;
+    for (const auto &group : links)
+      for (size_t i = 1; i < group.size(); i++)
+        DrawLineEx(scr(fireflies[group[0]].pos()), scr(fireflies[group[i]].pos()),
+          1, (Color){255, 255, 16, 96});
+    if (ed_link_from != -1)
+      DrawRing(scr(fireflies[ed_link_from].pos()), 8, 10, 0, 360, 24,
+        (Color){255, 255, 16, 255});
+
+    char s[96];
+    if (solver == nullptr) {
+      snprintf(s, sizeof s, "Editing: no bellflowers");
+    } else {
+      long n = solver->n_samples, k = solver->n_solved;
+      if (k > 0)
+        // 0 when every arrangement works; 3 for one in a thousand
+        snprintf(s, sizeof s, "Solvable: %ld of %ld arrangements (difficulty %.1f)",
+          k, n, log10f((float)n / k));
+      else if (n < ED_SAMPLES_PROOF)
+        snprintf(s, sizeof s, "Not solved yet: %ld arrangements", n);
+      else
+        snprintf(s, sizeof s, "No solution in %ld sampled arrangements", n);
+    }
+    painter::text(s, 24, vec2(W - 20, 20), vec2(1, 0), tint4(0.9, 0.9, 0.9, 1));
+    if (ed_msg != nullptr && T - ed_msg_time < 480)
+      painter::text(ed_msg, 24, vec2(W - 20, 50), vec2(1, 0), tint4(0.6, 0.9, 0.6, 1));
+  }
+#endif
+
   // Button callbacks
   void btn_play() {
     if (finish_timer >= 0) return;
@@ -821,6 +1952,11 @@ public:
     }
     last_tab_down = tab_down;
 
+#ifdef EDITOR
+    if (ed_key(rl::KEY_E)) ed_toggle();
+    if (editing && !(run_state & 1)) ed_update();
+#endif
+
 #ifdef SHOWCASE
     bool _1_down = rl::IsKeyDown(rl::KEY_ONE);
     if (!last_1_down && _1_down) show_title = !show_title;
@@ -829,24 +1965,30 @@ public:
     if (!last_2_down && _2_down) show_grid = !show_grid;
     last_2_down = _2_down;
     bool left_down = rl::IsKeyDown(rl::KEY_LEFT);
-    if (T >= 240 && !last_left_down && left_down) replace_scene(new scene_game(puzzle_id - 1));
+    if (T >= 240 && !last_left_down && left_down &&
+        has_puzzle(puzzle_id - 1))
+      replace_scene(new scene_game(puzzle_id - 1));
     last_left_down = left_down;
     bool right_down = rl::IsKeyDown(rl::KEY_RIGHT);
-    if (T >= 240 && !last_right_down && right_down) replace_scene(new scene_game(puzzle_id + 1));
+    if (T >= 240 && !last_right_down && right_down &&
+        has_puzzle(puzzle_id + 1))
+      replace_scene(new scene_game(puzzle_id + 1));
     last_right_down = right_down;
 #endif
 
     if (run_state & 1) for (int i = 0; i < (run_state >> 1); i++) {
-      for (auto &f : fireflies) f.update(tracks);
+      step_fireflies(fireflies, tracks, bellflowers, bf_on);
       trail_m.step();
 
       if (finish_timer == -1) {
         std::vector<float> trigger_ord, trigger_zero;
-        for (auto b : bellflowers)
-          if (b->update(fireflies)) {
+        for (size_t j = 0; j < bellflowers.size(); j++) {
+          bellflower *b = bellflowers[j];
+          if (b->step(bf_on[j])) {
             if (b->c == 0) trigger_zero.push_back(b->o.x);
             else trigger_ord.push_back(b->o.x);
           }
+        }
         // Play sounds
         if (!trigger_zero.empty()) {
           int total_zeros = 0;
@@ -896,7 +2038,16 @@ public:
     }
     if (finish_timer == 360 + 1.2 * 240 + 20)
       sound::play("puzzle_solved");
-    if (finish_timer == 960) {
+    if (finish_timer == 960 && !autoplay) {
+#ifdef EDITOR
+      if (editing) {
+        // Back to the arrangement for more editing
+        finish_timer = -1;
+        run_state &= ~1;
+        stop_run();
+        return;
+      }
+#endif
       if (to_text != -1)
         replace_scene(scene_text(to_text));
       else
@@ -907,9 +2058,20 @@ public:
   void draw() {
     using namespace rl;
 
+    // Loading a target switches framebuffers, so step out of the
+    // offscreen one around it
+    float base_scale = fmaxf(RT_SCALE_BASE, scene_target_scale());
+    if (rt_scale_base != base_scale) {
+      EndMode2D();
+      EndTextureMode();
+      load_base_target(base_scale);
+      resume_scene_target();
+    }
+
     ClearBackground((Color){5, 8, 1, 255});
 
     // Background
+    jobs::wait(trees_job);
     for (int i = 0; i < BG_TREES_N; i++) {
       int id = i % 4;
 #ifdef SHOWCASE
@@ -947,27 +2109,42 @@ public:
       }
     }
 
-    // Render scaled to texture
+    // Render scaled to texture, in premultiplied alpha up to the composite
     BeginBlendMode(BLEND_ADD_COLORS);
 
     Color bg = (Color){0, 0, 0, 0};
     BeginTextureMode(texBloomBase);
-    BeginMode2D((Camera2D){(Vector2){0, 0}, (Vector2){0, 0}, 0, RT_SCALE_BASE});
+    BeginMode2D((Camera2D){(Vector2){0, 0}, (Vector2){0, 0}, 0, rt_scale_base});
       ClearBackground(bg);
       for (const auto t : tracks) t->draw(T);
       for (const auto &f : fireflies) f.draw(trail_m.pointer);
     EndMode2D();
     EndTextureMode();
 
+    Shader bloom = shaderBloom;
+    int bloomPassLoc = shaderBloomPassLoc;
+#ifdef SHOWCASE
+    if (glow_reference) {
+      if (shaderBloomRef.id == 0) {
+        char *vs = LoadFileText("res/bloom.vert");
+        shaderBloomRef = LoadShaderFromMemory(vs, BLOOM_REF_FRAG);
+        UnloadFileText(vs);
+        shaderBloomRefPassLoc = GetShaderLocation(shaderBloomRef, "pass");
+      }
+      bloom = shaderBloomRef;
+      bloomPassLoc = shaderBloomRefPassLoc;
+    }
+#endif
+
     int pass;
     BeginTextureMode(texBloomStage1);
     BeginMode2D((Camera2D){(Vector2){0, 0}, (Vector2){0, 0}, 0, RT_SCALE_BLOOM});
     pass = 1;
-    SetShaderValue(shaderBloom, shaderBloomPassLoc, &pass, SHADER_UNIFORM_INT);
-    BeginShaderMode(shaderBloom);
+    SetShaderValue(bloom, bloomPassLoc, &pass, SHADER_UNIFORM_INT);
+    BeginShaderMode(bloom);
       ClearBackground(bg);
       DrawTexturePro(texBloomBase.texture,
-        (Rectangle){0, 0, W * RT_SCALE_BASE, -H * RT_SCALE_BASE},
+        (Rectangle){0, 0, W * rt_scale_base, -H * rt_scale_base},
         (Rectangle){0, 0, W, H},
         (Vector2){0, 0}, 0, WHITE);
     EndShaderMode();
@@ -977,8 +2154,8 @@ public:
     BeginTextureMode(texBloomStage2);
     BeginMode2D((Camera2D){(Vector2){0, 0}, (Vector2){0, 0}, 0, RT_SCALE_BLOOM});
     pass = 2;
-    SetShaderValue(shaderBloom, shaderBloomPassLoc, &pass, SHADER_UNIFORM_INT);
-    BeginShaderMode(shaderBloom);
+    SetShaderValue(bloom, bloomPassLoc, &pass, SHADER_UNIFORM_INT);
+    BeginShaderMode(bloom);
       ClearBackground(bg);
       DrawTexturePro(texBloomStage1.texture,
         (Rectangle){0, 0, W * RT_SCALE_BLOOM, -H * RT_SCALE_BLOOM},
@@ -989,20 +2166,29 @@ public:
     EndTextureMode();
 
     EndBlendMode();
+    resume_scene_target();
 
     int finish_anim = -1;
     if (finish_timer >= 360)
       finish_anim = finish_timer - 360;
     for (const auto b : bellflowers) b->draw1(finish_anim);
 
+#ifdef SHOWCASE
+    bool premul = !glow_reference;
+#else
+    const bool premul = true;
+#endif
+    if (premul) BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
     DrawTexturePro(texBloomBase.texture,
-      (Rectangle){0, 0, W * RT_SCALE_BASE, -H * RT_SCALE_BASE},
+      (Rectangle){0, 0, W * rt_scale_base, -H * rt_scale_base},
       (Rectangle){0, 0, W, H},
-      (Vector2){0, 0}, 0, (Color){255, 255, 255, 160});
+      (Vector2){0, 0}, 0,
+      premul ? (Color){160, 160, 160, 160} : (Color){255, 255, 255, 160});
     DrawTexturePro(texBloomStage2.texture,
       (Rectangle){0, 0, W * RT_SCALE_BLOOM, -H * RT_SCALE_BLOOM},
       (Rectangle){0, 0, W, H},
       (Vector2){0, 0}, 0, WHITE);
+    if (premul) EndBlendMode();
 
     for (const auto b : bellflowers) b->draw2(finish_anim);
 
@@ -1046,6 +2232,10 @@ public:
     buttons.draw();
 #endif
 
+#ifdef EDITOR
+    if (editing) ed_draw();
+#endif
+
     // Title
     if (show_title) {
       char title_text[64];
@@ -1078,3 +2268,429 @@ public:
 scene *scene_game(int puzzle_id) {
   return new class scene_game(puzzle_id);
 }
+
+#ifdef SHOWCASE
+scene *scene_game_config(const char *name, bool run) {
+  int puzzle_id, n;
+  if (sscanf(name, "%2d%n", &puzzle_id, &n) != 1) return nullptr;
+  if (!scene_game::has_puzzle(puzzle_id)) return nullptr;
+  auto s = new class scene_game(puzzle_id);
+  name += n;
+  for (auto t : s->tracks)
+    if (!(t->flags & scene_game::track::FIXED)) {
+      int x, y;
+      if (sscanf(name, "_%d_%d%n", &x, &y, &n) != 2) break;
+      t->o = vec2(x / 10000.0f, y / 10000.0f);
+      name += n;
+    }
+  for (auto &f : s->fireflies) {
+    int t;
+    if (sscanf(name, "_%d%n", &t, &n) != 1) break;
+    f.t = t / 10000.0f;
+    name += n;
+  }
+  s->trail_m.recalc_init();
+  if (run) {
+    s->autoplay = true;
+    s->run_state |= 1;
+    s->start_run();
+  }
+  return s;
+}
+#endif
+
+scene *scene_game_bench(int puzzle_id) {
+  auto s = new class scene_game(puzzle_id);
+  s->tutorials = {};
+  s->update_tut_show_range(true);
+  s->autoplay = true;
+  s->run_state = (32 << 1) | 1;
+  s->start_run();
+  return s;
+}
+
+scene *scene_game_generated(int n_tracks, int n_fireflies, int n_bellflowers,
+  float colli, unsigned seed)
+{
+  using track = scene_game::track;
+  auto rnd = [&seed]() { return scene_game::board_sim::rnd(seed); };
+  const float BW = scene_game::BOARD_W, BH = scene_game::BOARD_H;
+  static const float v_choices[] = {-1.5, -1, -0.5, 0.5, 1, 1.5};
+
+  auto s = new class scene_game(-1);
+  for (int i = 0; i < n_tracks; i++) {
+    float x = (rnd() - 0.5f) * BW;
+    float y = (rnd() - 0.5f) * BH;
+    unsigned flags = 0;
+    if (rnd() < colli) flags = (rnd() < 0.5f ? track::ATTRACT : track::RETURN);
+    float size = 0.5f + rnd() * 3;
+    if (rnd() < 0.3f) {
+      float a = rnd() * (float)M_PI * 2;
+      s->tracks.push_back(new scene_game::track_seg(
+        vec2(x, y), vec2(size, 0).rot(a), flags));
+    } else {
+      s->tracks.push_back(new scene_game::track_cir(vec2(x, y), size, flags));
+    }
+  }
+  for (int i = 0; i < n_fireflies && n_tracks > 0; i++) {
+    track *t = s->tracks[i % n_tracks];
+    float phase = rnd() * t->len;
+    s->fireflies.push_back(scene_game::firefly(t, phase, v_choices[(int)(rnd() * 5.999f)]));
+  }
+  float x_sum = 0;
+  for (int i = 0; i < n_bellflowers; i++) {
+    float x = (rnd() - 0.5f) * BW;
+    float y = (rnd() - 0.5f) * BH;
+    // Never reaches zero, so the board runs indefinitely
+    s->bellflowers.push_back(new scene_game::bellflower_ord(vec2(x, y), 1, 1 << 30));
+    x_sum += x;
+  }
+  s->bellflowers_x_cen = (n_bellflowers > 0 ? x_sum / n_bellflowers : 0);
+  scene_game::build_links(s->fireflies, s->links, s->ff_links);
+  s->trail_m.recalc_init();
+
+  s->autoplay = true;
+  s->run_state = (32 << 1) | 1;
+  s->start_run();
+  return s;
+}
+
+#ifndef PLATFORM_WEB
+// ==== Fuzzing of firefly dynamics ====
+
+#include <cstring>
+
+static const int FUZZ_STEPS = scene_game::STEPS * 20;
+
+struct fuzz_case {
+  struct ff {
+    int tr;
+    double t;     // Fraction of track length
+    float v;
+  };
+  // Never modified once generated, so shared between minimization steps
+  std::vector<std::shared_ptr<const scene_game::track>> tracks;
+  std::vector<ff> fireflies;
+  int steps;
+};
+
+// Runs a case through the game's own update routine and checks invariants.
+// Returns nullptr if all hold, otherwise a description and the failing step
+static const char *fuzz_run(const fuzz_case &c, int &fail_step)
+{
+  using track = scene_game::track;
+  using firefly = scene_game::firefly;
+  // A step of at most 2/240 units may cross two collision tracks where
+  // they cross each other; more takes a degenerate layout. This many
+  // steps in a row with events count as a bounce loop
+  const int MAX_CROSSINGS = 2;
+  const int MAX_EVENT_RUN = 16;
+
+  std::vector<track *> tracks;
+  for (const auto &t : c.tracks) tracks.push_back((track *)t.get());
+  std::vector<firefly> fireflies;
+  for (const auto &f : c.fireflies)
+    fireflies.push_back(firefly(tracks[f.tr], tracks[f.tr]->len * f.t, f.v));
+  std::vector<int> event_run(fireflies.size(), 0);
+
+  const char *fail = nullptr;
+  std::string saved;
+  int save_step = c.steps / 2, compare_step = c.steps * 3 / 4;
+
+  for (int step = 0; step < c.steps && fail == nullptr; step++) {
+    if (step == save_step)
+      saved = scene_game::state_text(tracks, fireflies);
+    if (step == compare_step) {
+      // Save/restore: replaying from the serialized state into fresh
+      // fireflies must agree exactly
+      std::vector<firefly> restored;
+      restored.reserve(fireflies.size());
+      for (size_t i = 0; i < fireflies.size(); i++)
+        restored.push_back(firefly(tracks[0], 0, 0));
+      if (!scene_game::load_state(saved.c_str(), tracks, restored)) {
+        fail = "serialized state does not load";
+      } else {
+        for (int i = save_step; i < compare_step; i++)
+          for (auto &f : restored) f.update(tracks);
+        if (scene_game::state_text(tracks, restored) !=
+            scene_game::state_text(tracks, fireflies))
+          fail = "state differs after save/restore";
+      }
+      if (fail != nullptr) { fail_step = step; break; }
+    }
+
+    for (size_t i = 0; i < fireflies.size(); i++) {
+      firefly &f = fireflies[i];
+      int crossings;
+      int events = f.update(tracks, &crossings);
+
+      bool on_track = false;
+      for (const auto t : tracks) if (t == f.tr) on_track = true;
+      if (!on_track) { fail = "firefly left the track list"; break; }
+      if (!(f.t >= 0 && f.t < f.tr->len)) { fail = "phase out of [0, len)"; break; }
+      if (crossings > MAX_CROSSINGS) { fail = "too many events in one step"; break; }
+      if (events > 0) {
+        if (++event_run[i] >= MAX_EVENT_RUN) { fail = "bounce loop"; break; }
+      } else {
+        event_run[i] = 0;
+      }
+    }
+    if (fail != nullptr) fail_step = step;
+  }
+
+  return fail;
+}
+
+static fuzz_case fuzz_gen(unsigned &seed)
+{
+#define rnd() ( \
+  (seed = (seed * 1103515245 + 12345) & 0x7fffffff), \
+  ((float)seed / (float)0x7fffffff) \
+)
+  using track = scene_game::track;
+  static const unsigned flag_choices[] = {0, 0, track::ATTRACT, track::RETURN};
+  static const float v_choices[] = {-2, -1, -0.5, 0.5, 1, 1.9};
+  const float BW = scene_game::BOARD_W, BH = scene_game::BOARD_H;
+  // Offset from the origin, up to `r` along each axis
+  auto offs = [&](float r) {
+    float x = (rnd() * 2 - 1) * r;
+    float y = (rnd() * 2 - 1) * r;
+    return vec2(x, y);
+  };
+
+  fuzz_case c;
+  int n_tracks = 1 + (int)(rnd() * 5.999f);
+  for (int i = 0; i < n_tracks; i++) {
+    float x = (rnd() - 0.5f) * BW;
+    float y = (rnd() - 0.5f) * BH;
+    vec2 o = vec2(x, y);
+    unsigned flags = flag_choices[(int)(rnd() * 3.999f)];
+    float kind = rnd();
+    track *t;
+    if (kind < 0.4f) {
+      t = new scene_game::track_cir(o, 0.5f + rnd() * 4.5f, flags);
+    } else if (kind < 0.6f) {
+      float a = rnd() * (float)M_PI * 2;
+      t = new scene_game::track_seg(o, vec2(0.5f + rnd() * 4.5f, 0).rot(a), flags);
+    } else if (kind < 0.75f) {
+      float a = 0.5f + rnd() * 4.5f;
+      float b = 0.5f + rnd() * 4.5f;
+      float rot = rnd() * (float)M_PI * 2;
+      t = new scene_game::track_ell(o, a, b, flags, rot);
+    } else if (kind < 0.9f) {
+      // Kept from degenerating: the ends are at least 1 apart
+      float r3 = 1 + rnd() * 4;
+      vec2 p3 = vec2(r3, 0).rot(rnd() * (float)M_PI * 2);
+      vec2 p1 = offs(4);
+      vec2 p2 = offs(4);
+      t = new scene_game::track_bez(o, vec2(0, 0), p1, p2, p3, flags);
+    } else {
+      // Control points in turn around the origin; may self-intersect
+      int n = 3 + (int)(rnd() * 3.999f);
+      std::vector<vec2> ctrl;
+      for (int j = 0; j < n; j++) {
+        float r = 1 + rnd() * 3;
+        float a = ((float)j + rnd() * 0.8f) / n * (float)M_PI * 2;
+        ctrl.push_back(vec2(r, 0).rot(a));
+      }
+      t = new scene_game::track_spl(o, ctrl, flags);
+    }
+    c.tracks.emplace_back(t);
+  }
+  int n_fireflies = 1 + (int)(rnd() * 4.999f);
+  for (int i = 0; i < n_fireflies; i++) {
+    fuzz_case::ff f;
+    f.tr = (int)(rnd() * (n_tracks - 0.001f));
+    f.t = rnd() * 0.999f;
+    f.v = v_choices[(int)(rnd() * 5.999f)];
+    c.fireflies.push_back(f);
+  }
+  c.steps = FUZZ_STEPS;
+#undef rnd
+  return c;
+}
+
+// Greedily drops fireflies, tracks and trailing steps
+// while the same failure still occurs
+static void fuzz_minimize(fuzz_case &c, const char *kind)
+{
+  int fail_step;
+  auto fails = [&](const fuzz_case &d) {
+    const char *f = fuzz_run(d, fail_step);
+    return f != nullptr && strcmp(f, kind) == 0;
+  };
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int i = 0; c.fireflies.size() > 1 && i < (int)c.fireflies.size(); i++) {
+      fuzz_case d = c;
+      d.fireflies.erase(d.fireflies.begin() + i);
+      if (fails(d)) { c = d; changed = true; i--; }
+    }
+    for (int i = 0; c.tracks.size() > 1 && i < (int)c.tracks.size(); i++) {
+      fuzz_case d = c;
+      d.tracks.erase(d.tracks.begin() + i);
+      d.fireflies.clear();
+      for (auto f : c.fireflies) if (f.tr != i) {
+        if (f.tr > i) f.tr--;
+        d.fireflies.push_back(f);
+      }
+      if (!d.fireflies.empty() && fails(d)) { c = d; changed = true; i--; }
+    }
+  }
+
+  // Stop right after the failure, unless the check depends on the length
+  fuzz_run(c, fail_step);
+  fuzz_case d = c;
+  d.steps = fail_step + 1;
+  if (fails(d)) c = d;
+}
+
+// Writes a case in the format of puzzles.hh
+static void fuzz_write(FILE *f, const fuzz_case &c, const char *kind, unsigned seed)
+{
+  int fail_step = -1;
+  fuzz_run(c, fail_step);
+  fprintf(f, "// Fuzz seed %u: %s at step %d (%.2f s at 1x)\n",
+    seed, kind, fail_step, (float)fail_step / scene_game::STEPS);
+  fprintf(f, "case 97:\n  title = \"Fuzz %u\";\n  tracks = {\n", seed);
+  for (const auto &t : c.tracks) {
+    std::string s = "    ";
+    t->write(s);
+    fprintf(f, "%s,\n", s.c_str());
+  }
+  fprintf(f, "  };\n  fireflies = {\n");
+  for (const auto &ff : c.fireflies)
+    fprintf(f, "    F(%d, %.17g, %.9g),\n", ff.tr, ff.t, ff.v);
+  fprintf(f, "  };\n  bellflowers = {\n"
+    "    B_ord(vec2(-99, -99), 1, 1),\n  };\n  break;\n");
+}
+
+int fuzz(int seconds)
+{
+  // One long job per worker, plus one that the main thread picks up
+  unsigned n_threads = jobs::workers() + 1;
+
+  std::atomic<long> total_steps(0), total_cases(0);
+  std::atomic<bool> stop(false);
+  std::mutex fail_mutex;
+  fuzz_case fail_case;
+  const char *fail_kind = nullptr;
+  unsigned fail_seed = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::seconds(seconds);
+  std::vector<job_ref> runs;
+  for (unsigned i = 0; i < n_threads; i++) {
+    runs.push_back(jobs::run([&, i]() {
+      unsigned seed = 20220827 + i * 7919;
+      while (!stop && std::chrono::steady_clock::now() < deadline) {
+        unsigned case_seed = seed;
+        fuzz_case c = fuzz_gen(seed);
+        int fail_step;
+        const char *kind = fuzz_run(c, fail_step);
+        total_steps += (long)c.steps * c.fireflies.size();
+        total_cases++;
+        if (kind != nullptr) {
+          std::lock_guard<std::mutex> lock(fail_mutex);
+          if (fail_kind == nullptr) {
+            fail_case = c;
+            fail_kind = kind;
+            fail_seed = case_seed;
+          }
+          stop = true;
+        }
+      }
+    }));
+  }
+  for (const auto &j : runs) jobs::wait(j);
+
+  double secs = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  printf("%ld cases, %ld firefly steps in %.1f s on %u threads "
+    "(%.2fM steps/s per thread)\n",
+    (long)total_cases, (long)total_steps, secs, n_threads,
+    total_steps / secs / n_threads / 1e6);
+
+  if (fail_kind == nullptr) return 0;
+
+  fuzz_minimize(fail_case, fail_kind);
+  char path[32];
+  snprintf(path, sizeof path, "fuzz_%u.txt", fail_seed);
+  FILE *f = fopen(path, "w");
+  if (f != nullptr) {
+    fuzz_write(f, fail_case, fail_kind, fail_seed);
+    fclose(f);
+  }
+  fuzz_write(stdout, fail_case, fail_kind, fail_seed);
+  return 1;
+}
+
+// ==== Search for solutions ====
+
+#include <set>
+
+int solve(int puzzle_id, int seconds)
+{
+  const char *title;
+  std::vector<scene_game::track *> tracks;
+  std::vector<scene_game::firefly> fireflies;
+  std::vector<scene_game::bellflower *> bellflowers;
+  std::vector<std::vector<int>> links;
+  std::vector<scene_game::tutorial> tutorials;
+  int to_text;
+  scene_game::load_puzzle(puzzle_id, title, tracks, fireflies, bellflowers,
+    links, tutorials, to_text);
+  if (tracks.empty()) {
+    fprintf(stderr, "No puzzle %d\n", puzzle_id);
+    return 1;
+  }
+  eval_cache::open("eval_cache.bin", EVAL_CACHE_SIZE);
+
+  unsigned n_threads = jobs::workers() + 1;
+  std::atomic<long> n_evals(0), n_cached(0);
+  std::mutex found_mutex;
+  std::set<std::string> found;
+
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::seconds(seconds);
+  std::vector<job_ref> runs;
+  for (unsigned i = 0; i < n_threads; i++) {
+    runs.push_back(jobs::run([&, i]() {
+      unsigned seed = 20220903 + i * 7919;
+      scene_game::board_sim sim(tracks, fireflies, bellflowers, links);
+      std::vector<int> q;
+      while (std::chrono::steady_clock::now() < deadline) {
+        sim.sample(seed, q);
+        bool cached;
+        eval_outcome o = sim.evaluate(q, &cached);
+        if (cached) n_cached++; else n_evals++;
+        if (o.solved) {
+          sim.set_config(q);
+          std::string name = sim.name(puzzle_id);
+          std::lock_guard<std::mutex> lock(found_mutex);
+          if (found.insert(name).second) {
+            printf("%s\n", name.c_str());
+            fflush(stdout);
+          }
+        }
+      }
+    }));
+  }
+  for (const auto &j : runs) jobs::wait(j);
+
+  double secs = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  fprintf(stderr, "%ld evaluations, %ld cached in %.1f s on %u threads "
+    "(%.0f evaluations/s per thread); %d solutions\n",
+    (long)n_evals, (long)n_cached, secs, n_threads,
+    n_evals / secs / n_threads, (int)found.size());
+  eval_cache::stats();
+  eval_cache::close();
+
+  for (auto t : tracks) delete t;
+  for (auto b : bellflowers) delete b;
+  return found.empty() ? 1 : 0;
+}
+#endif
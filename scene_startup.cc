@@ -100,6 +100,7 @@ public:
     tex_glow = rl::LoadTexture("res/intro_glow.png");
     rl::GenTextureMipmaps(&tex_glow);
     rl::SetTextureFilter(tex_glow, rl::TEXTURE_FILTER_BILINEAR);
+    memstat::add(memstat::TEXTURE, memstat::tex_size(tex_glow));
 
     btns.buttons = {(button_group::button){
       vec2(W - 180, H - 116),
@@ -127,9 +128,12 @@ public:
   }
 
   ~scene_startup() {
+    memstat::sub(memstat::TEXTURE, memstat::tex_size(tex_glow));
     rl::UnloadTexture(tex_glow);
   }
 
+  const char *name() { return "startup"; }
+
   void pton(float x, float y) {
     if (ps.pton(x, y)) return;
     if (btns.pton(x, y)) return;
@@ -135,6 +135,8 @@ public:
   {
   }
 
+  const char *name() { return "text"; }
+
   void ptoff(float x, float y) {
     // Not ending, enough time, and not an entry for a puzzle
     if (script[entry_id].puzzle != -2 && since_change >= 180 &&
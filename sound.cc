@@ -5,8 +5,30 @@ using namespace rl;
 #include <cstdio>
 #include <cstring>
 #include <map>
+#include <string>
 
 static std::map<hash_t, Sound> sounds;
+// Sounds still being fetched, keyed by path hash
+static std::map<hash_t, hash_t> pending_sounds;
+
+static void sound_fetched(const char *path)
+{
+  auto p = pending_sounds.find(hash(path));
+  if (p == pending_sounds.end()) return;
+  hash_t h = p->second;
+  pending_sounds.erase(p);
+  // Decode on a worker, create the audio buffer on the main thread
+  auto wave = std::make_shared<Wave>();
+  std::string s(path);
+  job_ref decode = jobs::run([wave, s]() { *wave = LoadWave(s.c_str()); });
+  jobs::run_main([wave, h]() {
+    Sound snd = LoadSoundFromWave(*wave);
+    UnloadWave(*wave);
+    memstat::add(memstat::SOUND, memstat::sound_size(snd));
+    sounds[h] = snd;
+    flight::mark(flight::ASSET_LOAD);
+  }, {decode});
+}
 
 static inline void load_sound(const char *name)
 {
@@ -15,13 +37,15 @@ static inline void load_sound(const char *name)
     puts("Collision!");
     return;
   }
+  // Silent until fetched
+  sounds[h] = (Sound){};
 
   size_t l = strlen(name) + 9;
   char *path = new char[l];
   snprintf(path, l, "res/%s.ogg", name);
-  Sound snd = LoadSound(path);
+  pending_sounds[hash(path)] = h;
+  fetch_res(path, sound_fetched);
   delete[] path;
-  sounds[h] = snd;
 }
 
 void sound::init()
@@ -43,6 +67,7 @@ void sound::play(const char *name, float pan)
     puts("Unknown sound");
     return;
   }
+  if (p->second.frameCount == 0) return;  // Not fetched yet
   // Raylib 4.1 ensures that each instance has its own panning value
   SetSoundPan(p->second, pan);
   PlaySoundMulti(p->second);
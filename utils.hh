@@ -3,6 +3,8 @@
 
 #include "main.hh"
 
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <vector>
 
@@ -80,4 +82,47 @@ static inline hash_t hash(const char *s)
   return r;
 }
 
+// 64-bit FNV-1a, for keys that must not collide in practice
+static inline uint64_t hash64(const void *data, size_t n, uint64_t h = 14695981039346656037ull)
+{
+  const unsigned char *p = (const unsigned char *)data;
+  for (size_t i = 0; i < n; i++) h = (h ^ p[i]) * 1099511628211ull;
+  return h;
+}
+
+// Persistent cache of configuration evaluations
+
+struct eval_outcome {
+  int solved;     // All bellflowers reached zero together
+  int steps;      // Step at which the run finished or was abandoned
+  int period;     // Length of a trigger-free cycle that ended the run, or 0
+  signed char counts[8];  // Final counts of the first bellflowers
+};
+
+// Version of the simulation behind the outcomes: bump it whenever a
+// change makes runs of a board end differently. A cache file written
+// by another version is cleared
+static const uint32_t EVAL_SIM_VERSION = 2;
+
+// Entries in the shared cache file; a file of another size is cleared
+static const int EVAL_CACHE_SIZE =
+#ifdef PLATFORM_WEB
+  1 << 16
+#else
+  1 << 20
+#endif
+;
+
+class eval_cache {
+public:
+  // Maps the file (created if needed) holding up to `capacity` entries;
+  // an in-memory table is used if that fails
+  static void open(const char *path, int capacity);
+  static void close();
+  // Safe to call from any thread
+  static bool lookup(uint64_t key, eval_outcome &o);
+  static void store(uint64_t key, const eval_outcome &o);
+  static void stats();
+};
+
 #endif